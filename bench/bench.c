@@ -0,0 +1,446 @@
+/*
+ * Benchmark suite for the IPv4 parser
+ *
+ * Measures ns/address and addresses/sec for every parse engine and for the
+ * batch API over a set of generated corpora, and prints the results as JSON
+ * so they can be compared across releases. The corpora come from a fixed-seed
+ * generator, so every run (and every machine) measures exactly the same input.
+ *
+ * Build and run with: make bench
+ */
+
+// Linked against libvalidate-ip like any other user, so it measures the code
+// (and, with LTO=1, the inlining) that callers of the library get
+#include "../validate-ip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+// Number of addresses in each generated corpus
+#define BENCH_DEFAULT_SIZE (1 << 16)
+
+// Minimum measuring time per (engine, corpus) pair, in milliseconds
+#define BENCH_DEFAULT_MIN_MS 200
+
+// Repetitions per pair; the fastest one is reported to filter out noise
+#define BENCH_RUNS 5
+
+// Entries handed to validate_ip_batch() per call, matching a typical worker batch
+#define BENCH_BATCH 4096
+
+// Largest thread count of the scaling run; counts double from 1 up to this
+#define BENCH_DEFAULT_MAX_THREADS 64
+
+/*
+ * Deterministic xorshift64* generator, so corpora are reproducible without
+ * depending on the C library's rand()
+ */
+static uint64_t bench_rng_state;
+
+static uint64_t bench_rand(void) {
+    bench_rng_state ^= bench_rng_state >> 12;
+    bench_rng_state ^= bench_rng_state << 25;
+    bench_rng_state ^= bench_rng_state >> 27;
+    return bench_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned bench_below(unsigned n) {
+    return (unsigned)(bench_rand() % n);
+}
+
+/*
+ * A corpus: n candidate strings stored back to back in one arena, each also
+ * null-terminated so the same corpus works for every entry point
+ */
+struct corpus {
+    const char* name;
+    const char** ips;
+    size_t* lens;
+    char* arena;
+    size_t n;
+};
+
+// Writes a random valid address into buf and returns its length
+static size_t gen_valid(char* buf) {
+    return (size_t)sprintf(buf, "%u.%u.%u.%u", bench_below(256), bench_below(256),
+                           bench_below(256), bench_below(256));
+}
+
+// Writes an address that is wrong in one of the common ways and returns its length
+static size_t gen_invalid(char* buf) {
+    unsigned a = bench_below(256), b = bench_below(256), c = bench_below(256), d = bench_below(256);
+    switch (bench_below(8)) {
+    case 0:  return (size_t)sprintf(buf, "%u.%u.%u", a, b, c);              // Too few octets
+    case 1:  return (size_t)sprintf(buf, "%u.%u.%u.%u.%u", a, b, c, d, a);  // Too many octets
+    case 2:  return (size_t)sprintf(buf, "%u.%u.%u.%u", a, b, c, 256 + d);  // Out of range
+    case 3:  return (size_t)sprintf(buf, "%u.%u.0%u.%u", a, b, c, d);       // Leading zero
+    case 4:  return (size_t)sprintf(buf, "%u.%u..%u", a, b, c);             // Empty octet
+    case 5:  return (size_t)sprintf(buf, "%u.%u.%u.%ux", a, b, c, d);       // Stray character
+    case 6:  return (size_t)sprintf(buf, "%u.%u.%u.%u ", a, b, c, d);       // Trailing space
+    default: return (size_t)sprintf(buf, "host%u.example", a);              // Not an address
+    }
+}
+
+// Near misses that get as far into the parser as possible before failing (or just passing)
+static size_t gen_adversarial(char* buf) {
+    static const char* const cases[] = {
+        "255.255.255.255", "255.255.255.256", "255.255.255.2555", "255.255.256.255",
+        "199.199.199.199", "099.199.199.199", "199.199.199.019", "199.199.199.00",
+        "0.0.0.0", "00.0.0.0", "0.0.0.00", "1.1.1.01",
+        "249.249.249.250", "250.250.250.260", "100.100.100.100", "100.100.100.1000",
+        "1.2.3.4.", ".1.2.3.4", "1.2.3..4", "255.255.255.25",
+    };
+    const char* s = cases[bench_below(sizeof(cases) / sizeof(cases[0]))];
+    size_t len = strlen(s);
+    memcpy(buf, s, len + 1);
+    return len;
+}
+
+/*
+ * Log-shaped traffic: most lines come from a small set of hot addresses
+ * (private ranges and a few public ones), the rest from random sources, plus
+ * the placeholders and IPv6 addresses that show up in real access logs
+ */
+static size_t gen_log(char* buf) {
+    unsigned r = bench_below(100);
+    if (r < 60) {
+        // Hot internal sources, skewed towards the first few
+        unsigned host = bench_below(1 + bench_below(256));
+        return (size_t)sprintf(buf, "10.%u.%u.%u", host % 4, host / 4 % 16, host);
+    }
+    if (r < 75) {
+        return (size_t)sprintf(buf, "192.168.%u.%u", bench_below(4), 1 + bench_below(254));
+    }
+    if (r < 95) {
+        return gen_valid(buf);
+    }
+    if (r < 98) {
+        memcpy(buf, "-", 2);
+        return 1;
+    }
+    return (size_t)sprintf(buf, "2001:db8::%x", bench_below(65536));
+}
+
+// Fills a corpus with n entries produced by gen from the given seed
+static int corpus_build(struct corpus* c, const char* name, size_t n, uint64_t seed,
+                        size_t (*gen)(char*)) {
+    c->name = name;
+    c->n = n;
+    c->ips = malloc(n * sizeof(*c->ips));
+    c->lens = malloc(n * sizeof(*c->lens));
+    c->arena = malloc(n * 32);
+    if (c->ips == NULL || c->lens == NULL || c->arena == NULL) {
+        return 0;
+    }
+    bench_rng_state = seed;
+    char* p = c->arena;
+    for (size_t i = 0; i < n; i++) {
+        size_t len = gen(p);
+        c->ips[i] = p;
+        c->lens[i] = len;
+        p += len + 1;
+    }
+    return 1;
+}
+
+static void corpus_free(struct corpus* c) {
+    free(c->ips);
+    free(c->lens);
+    free(c->arena);
+}
+
+// Valid and invalid entries with equal probability
+static size_t gen_mixed(char* buf) {
+    return bench_below(2) ? gen_valid(buf) : gen_invalid(buf);
+}
+
+/*
+ * Mixed corpora at the invalid rates seen across real sources (0.1% to 40%),
+ * which show whether an engine's cost depends on how often inputs are wrong
+ */
+static size_t gen_mixed_rate(char* buf, unsigned invalid_per_mille) {
+    return bench_below(1000) < invalid_per_mille ? gen_invalid(buf) : gen_valid(buf);
+}
+
+static size_t gen_mixed_0_1(char* buf) {
+    return gen_mixed_rate(buf, 1);
+}
+
+static size_t gen_mixed_5(char* buf) {
+    return gen_mixed_rate(buf, 50);
+}
+
+static size_t gen_mixed_20(char* buf) {
+    return gen_mixed_rate(buf, 200);
+}
+
+static size_t gen_mixed_40(char* buf) {
+    return gen_mixed_rate(buf, 400);
+}
+
+// Results are folded into this so the measured work cannot be optimized away
+static volatile uint64_t bench_sink;
+
+// The dedup cache is per thread; the benchmark runs it on the main thread only
+static struct ipv4_cache bench_cache;
+
+static int parse_cached(const char* ip, size_t len, uint32_t* out) {
+    return ipv4_cache_parse(&bench_cache, ip, len, out);
+}
+
+// The flags are folded into the result so they count towards the checksum
+static int parse_classified(const char* ip, size_t len, uint32_t* out) {
+    unsigned flags;
+    int ok = parse_ipv4_classify(ip, len, out, &flags);
+    return ok + (int)flags;
+}
+
+/*
+ * The measured entry points. Single-address engines are called through a
+ * pointer, so each one pays the same call overhead a library user would.
+ */
+struct engine {
+    const char* name;
+    int (*parse)(const char*, size_t, uint32_t*);  // NULL for the batch API
+    int available;
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// One pass over the corpus; returns a checksum of the results
+static uint64_t run_pass(const struct engine* e, const struct corpus* c,
+                         uint8_t* bitmap, uint32_t* addrs) {
+    uint64_t sum = 0;
+    if (e->parse == NULL) {
+        for (size_t i = 0; i < c->n; i += BENCH_BATCH) {
+            size_t k = c->n - i < BENCH_BATCH ? c->n - i : BENCH_BATCH;
+            sum += validate_ip_batch(c->ips + i, c->lens + i, k, bitmap, addrs);
+            sum += addrs[k - 1];
+        }
+        return sum;
+    }
+    for (size_t i = 0; i < c->n; i++) {
+        uint32_t addr = 0;
+        sum += (uint64_t)e->parse(c->ips[i], c->lens[i], &addr) + addr;
+    }
+    return sum;
+}
+
+/*
+ * Multithreaded scaling run
+ * 
+ * Every thread parses the same shared, read-only corpus with parse_ipv4()
+ * without any locking. Because the parser keeps no static or global state the
+ * aggregate throughput should grow linearly with the thread count until the
+ * machine runs out of cores.
+ */
+
+// Per-thread state, padded so counters of different threads never share a cache line
+struct scaling_worker {
+    const struct corpus* c;
+    const atomic_int* go;      // Set by the main thread to start all workers together
+    const atomic_int* stop;    // Set by the main thread when the window is over
+    uint64_t addresses;        // Addresses parsed inside the window
+    uint64_t sum;              // Checksum of the results
+    pthread_t thread;
+    char pad[64];
+};
+
+static void* scaling_thread(void* arg) {
+    struct scaling_worker* w = arg;
+    while (!atomic_load_explicit(w->go, memory_order_acquire)) {
+        sched_yield();  // Wait so every worker starts at the same moment
+    }
+    uint64_t sum = 0, addresses = 0;
+    while (!atomic_load_explicit(w->stop, memory_order_relaxed)) {
+        for (size_t i = 0; i < w->c->n; i++) {
+            uint32_t addr = 0;
+            sum += (uint64_t)parse_ipv4(w->c->ips[i], w->c->lens[i], &addr) + addr;
+        }
+        addresses += w->c->n;
+    }
+    w->addresses = addresses;
+    w->sum = sum;
+    return NULL;
+}
+
+// Runs threads workers over c for about window_ns; returns aggregate addresses/sec (0 on failure)
+static double run_scaling(const struct corpus* c, long threads, double window_ns) {
+    struct scaling_worker* workers = calloc((size_t)threads, sizeof(*workers));
+    if (workers == NULL) {
+        return 0;
+    }
+    atomic_int go = 0, stop = 0;
+    long started = 0;
+    for (; started < threads; started++) {
+        workers[started].c = c;
+        workers[started].go = &go;
+        workers[started].stop = &stop;
+        if (pthread_create(&workers[started].thread, NULL, scaling_thread, &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    double start = now_ns();
+    atomic_store_explicit(&go, 1, memory_order_release);
+    struct timespec window = { (time_t)(window_ns / 1e9), (long)((uint64_t)window_ns % 1000000000u) };
+    nanosleep(&window, NULL);
+    atomic_store_explicit(&stop, 1, memory_order_relaxed);
+
+    uint64_t addresses = 0;
+    for (long t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        addresses += workers[t].addresses;
+        bench_sink += workers[t].sum;
+    }
+    double elapsed = now_ns() - start;
+    free(workers);
+    return started == threads ? (double)addresses * 1e9 / elapsed : 0;
+}
+
+/**
+ * Function: main
+ * Purpose: Runs every engine over every corpus and prints the results as JSON
+ *
+ * Options: --size N          addresses per corpus (default 65536)
+ *          --min-ms N        minimum measuring time per engine and corpus in milliseconds (default 200)
+ *          --max-threads N   largest thread count of the scaling run, 0 to skip it (default 64)
+ *
+ * Returns: 0 on success, 1 on allocation failure, 2 on usage errors
+ */
+int main(int argc, char* argv[]) {
+    size_t size = BENCH_DEFAULT_SIZE;
+    double min_ns = BENCH_DEFAULT_MIN_MS * 1e6;
+    long max_threads = BENCH_DEFAULT_MAX_THREADS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            min_ns = strtod(argv[++i], NULL) * 1e6;
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            max_threads = strtol(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--size N] [--min-ms N] [--max-threads N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (size == 0) {
+        fprintf(stderr, "bench: --size must be positive\n");
+        return 2;
+    }
+
+    struct engine engines[] = {
+        { "scalar", parse_ipv4_scalar, 1 },
+        { "table", parse_ipv4_table, 1 },
+        { "branchless", parse_ipv4_branchless, 1 },
+#ifdef IPV4_HAVE_SSSE3
+        { "ssse3", parse_ipv4_ssse3, __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt") },
+#endif
+#ifdef IPV4_HAVE_NEON
+        { "neon", parse_ipv4_neon, 1 },
+#endif
+        { "dispatch", parse_ipv4, 1 },
+        { "cached", parse_cached, 1 },
+        { "classify", parse_classified, 1 },
+        { "batch", NULL, 1 },
+    };
+    size_t engine_count = sizeof(engines) / sizeof(engines[0]);
+
+    struct corpus corpora[9];
+    int ok = corpus_build(&corpora[0], "valid", size, 1, gen_valid) &&
+             corpus_build(&corpora[1], "invalid", size, 2, gen_invalid) &&
+             corpus_build(&corpora[2], "mixed", size, 3, gen_mixed) &&
+             corpus_build(&corpora[3], "adversarial", size, 4, gen_adversarial) &&
+             corpus_build(&corpora[4], "log", size, 5, gen_log) &&
+             corpus_build(&corpora[5], "mixed-0.1%", size, 6, gen_mixed_0_1) &&
+             corpus_build(&corpora[6], "mixed-5%", size, 7, gen_mixed_5) &&
+             corpus_build(&corpora[7], "mixed-20%", size, 8, gen_mixed_20) &&
+             corpus_build(&corpora[8], "mixed-40%", size, 9, gen_mixed_40);
+    size_t corpus_count = sizeof(corpora) / sizeof(corpora[0]);
+    uint8_t* bitmap = malloc(BENCH_BATCH / 8);
+    uint32_t* addrs = malloc(BENCH_BATCH * sizeof(*addrs));
+    if (!ok || bitmap == NULL || addrs == NULL) {
+        fprintf(stderr, "bench: out of memory\n");
+        return 1;
+    }
+
+    printf("{\n  \"benchmark\": \"validate-ip\",\n  \"corpus_size\": %zu,\n  \"results\": [", size);
+    const char* sep = "\n";
+    for (size_t ci = 0; ci < corpus_count; ci++) {
+        const struct corpus* c = &corpora[ci];
+
+        // Count the valid entries once with the reference engine, for the report
+        size_t valid = 0;
+        for (size_t i = 0; i < c->n; i++) {
+            valid += (size_t)parse_ipv4_scalar(c->ips[i], c->lens[i], NULL);
+        }
+
+        for (size_t ei = 0; ei < engine_count; ei++) {
+            const struct engine* e = &engines[ei];
+            if (!e->available) {
+                continue;
+            }
+
+            // Warm caches and branch predictors, then keep the best of several timed runs
+            ipv4_cache_init(&bench_cache);
+            uint64_t checksum = run_pass(e, c, bitmap, addrs);
+            double best = 0;
+            for (int run = 0; run < BENCH_RUNS; run++) {
+                size_t passes = 0;
+                double start = now_ns(), elapsed;
+                do {
+                    checksum += run_pass(e, c, bitmap, addrs);
+                    passes++;
+                    elapsed = now_ns() - start;
+                } while (elapsed < min_ns / BENCH_RUNS);
+                double per = elapsed / ((double)passes * (double)c->n);
+                if (run == 0 || per < best) {
+                    best = per;
+                }
+            }
+
+            bench_sink += checksum;
+
+            printf("%s    {\"engine\": \"%s\", \"corpus\": \"%s\", \"valid\": %zu, "
+                   "\"ns_per_addr\": %.3f, \"addrs_per_sec\": %.0f}",
+                   sep, e->name, c->name, valid, best, 1e9 / best);
+            sep = ",\n";
+        }
+    }
+    printf("\n  ],\n  \"scaling\": [");
+
+    // Thread scaling over the mixed corpus, which exercises both accept and reject paths
+    sep = "\n";
+    double single = 0;
+    for (long threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = run_scaling(&corpora[2], threads, min_ns);
+        if (rate == 0) {
+            fprintf(stderr, "bench: could not start %ld threads\n", threads);
+            break;
+        }
+        if (threads == 1) {
+            single = rate;
+        }
+        printf("%s    {\"threads\": %ld, \"corpus\": \"%s\", \"addrs_per_sec\": %.0f, \"speedup\": %.2f}",
+               sep, threads, corpora[2].name, rate, rate / single);
+        sep = ",\n";
+    }
+    printf("\n  ]\n}\n");
+
+    for (size_t ci = 0; ci < corpus_count; ci++) {
+        corpus_free(&corpora[ci]);
+    }
+    free(bitmap);
+    free(addrs);
+    return 0;
+}
@@ -0,0 +1,1525 @@
+/*
+ * validate-ip: the command line program
+ * 
+ * A thin frontend over libvalidate-ip: the original interactive prompt, plus
+ * the line-oriented stream, mmap and pipeline modes for bulk input. All of
+ * the parsing lives in the library (validate-ip.h); this file only moves
+ * bytes in and out.
+ */
+
+// madvise() and its MADV_* advice are BSD extensions, hidden under strict -std=c11
+#define _DEFAULT_SOURCE
+
+#include "../validate-ip.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The --mmap and --pipeline modes need POSIX memory mapping, I/O and threads
+#if defined(__unix__) || defined(__APPLE__)
+#define VALIDATE_IP_HAVE_MMAP 1
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Line reader
+ * 
+ * The input layer shared by the interactive prompt and --stream: one reusable
+ * buffer whose size is a power of two, searched for newlines with memchr().
+ * Lines are handed out as slices into the buffer and never copied; the only
+ * copy is moving an unfinished last line to the front before the next read.
+ * 
+ * On POSIX systems the buffer is filled with read(), which returns as soon as
+ * anything is available, so the same reader works on a terminal (one line per
+ * read) and on a pipe or file (a full buffer per read). Elsewhere it falls
+ * back to getc(), stopping at each newline for the same reason.
+ * 
+ * A line that does not fit the buffer can never be an address. It comes back
+ * in buffer-sized pieces (LINE_PIECE) for the callers that want to pass it
+ * through, or line_reader_skip() drops the rest of it without handing it out.
+ */
+
+// Size of the line reader buffer used by the interactive prompt
+#define INTERACTIVE_BUFFER_SIZE 4096
+
+// What line_reader_next() found
+enum line_kind {
+    LINE_END = 0,    // No more input (check the error field for a read error)
+    LINE_COMPLETE,   // A whole line, or the last part of one, without its newline
+    LINE_PIECE       // The buffer filled up first; the line continues in the next call
+};
+
+struct line_reader {
+    FILE* in;        // Stream to read from
+    char* buf;       // Power-of-two sized buffer
+    size_t size;     // Size of buf
+    size_t start;    // First byte not yet handed out
+    size_t end;      // One past the last byte read
+    size_t scanned;  // Bytes after start already known to hold no newline
+    int eof;         // Set once the stream has ended
+    int error;       // Set if it ended with a read error
+};
+
+// Allocates the buffer; size must be a power of two. Returns 0 when out of memory
+static int line_reader_init(struct line_reader* r, FILE* in, size_t size) {
+    r->in = in;
+    r->buf = (size & (size - 1)) == 0 ? malloc(size) : NULL;
+    r->size = size;
+    r->start = r->end = r->scanned = 0;
+    r->eof = r->error = 0;
+    return r->buf != NULL;
+}
+
+static void line_reader_free(struct line_reader* r) {
+    free(r->buf);
+    r->buf = NULL;
+}
+
+// Moves the unconsumed bytes to the front and reads more. Returns 0 at the end of input
+static int line_reader_fill(struct line_reader* r) {
+    if (r->eof) {
+        return 0;
+    }
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    
+    size_t got = 0;
+#ifdef VALIDATE_IP_HAVE_MMAP
+    ssize_t n;
+    do {
+        n = read(fileno(r->in), r->buf + r->end, r->size - r->end);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        r->error = 1;
+    } else {
+        got = (size_t)n;
+    }
+#else
+    int c;
+    while (r->end + got < r->size && (c = getc(r->in)) != EOF) {
+        r->buf[r->end + got++] = (char)c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    r->error = ferror(r->in) != 0;
+#endif
+    if (got == 0) {
+        r->eof = 1;
+        return 0;
+    }
+    r->end += got;
+    return 1;
+}
+
+/**
+ * Function: line_reader_next
+ * Purpose: Returns the next line of input as a slice of the reader's buffer
+ * 
+ * The slice stays valid until the next call on the same reader. A last line
+ * without a newline is returned like any other.
+ * 
+ * Parameter: r    - the reader
+ * Parameter: line - receives a pointer to the first byte of the line
+ * Parameter: len  - receives the length of the line, without the newline
+ * Returns: LINE_COMPLETE, LINE_PIECE for a line longer than the buffer, or LINE_END
+ */
+static enum line_kind line_reader_next(struct line_reader* r, const char** line, size_t* len) {
+    for (;;) {
+        const char* from = r->buf + r->start;
+        const char* nl = memchr(from + r->scanned, '\n', r->end - r->start - r->scanned);
+        if (nl != NULL) {
+            *line = from;
+            *len = (size_t)(nl - from);
+            r->start += *len + 1;
+            r->scanned = 0;
+            return LINE_COMPLETE;
+        }
+        r->scanned = r->end - r->start;
+        
+        if (r->scanned == r->size) {
+            // The whole buffer is one unfinished line: hand it out as a piece
+            *line = r->buf;
+            *len = r->size;
+            r->start = r->end;
+            r->scanned = 0;
+            return LINE_PIECE;
+        }
+        
+        if (!line_reader_fill(r)) {
+            if (r->start == r->end) {
+                return LINE_END;
+            }
+            *line = r->buf + r->start;  // Last line, without a trailing newline
+            *len = r->end - r->start;
+            r->start = r->end;
+            r->scanned = 0;
+            return LINE_COMPLETE;
+        }
+    }
+}
+
+// Drops the rest of the current line (after a LINE_PIECE) up to and including its newline
+static void line_reader_skip(struct line_reader* r) {
+    for (;;) {
+        const char* nl = memchr(r->buf + r->start, '\n', r->end - r->start);
+        r->scanned = 0;
+        if (nl != NULL) {
+            r->start = (size_t)(nl - r->buf) + 1;
+            return;
+        }
+        r->start = r->end = 0;
+        if (!line_reader_fill(r)) {
+            return;
+        }
+    }
+}
+
+/**
+ * Function: run_interactive
+ * Purpose: Interactive mode that allows users to input and validate IP addresses
+ * 
+ * Program Flow:
+ * 1. Display welcome message and instructions
+ * 2. Prompt user for IP address input
+ * 3. Validate the entered IP address
+ * 4. Display validation result with helpful feedback
+ * 5. Ask user if they want to validate another IP
+ * 6. Repeat until user chooses to exit
+ * 
+ * Returns: 0 on successful program completion
+ */
+static int run_interactive(void) {
+    // Declare variables for user interaction
+    // One reader serves both the addresses and the y/n answers, so neither a
+    // long line nor an answer like "yes" can leave bytes behind for the next prompt
+    struct line_reader reader;
+    const char* line;    // Line just read, a slice of the reader's buffer
+    size_t len;          // Its length, without the newline
+    enum line_kind kind; // Whether it was the whole line
+    char choice = 'n';   // Variable to store user's yes/no choice for continuing
+    
+    if (!line_reader_init(&reader, stdin, INTERACTIVE_BUFFER_SIZE)) {
+        fprintf(stderr, "validate-ip: out of memory\n");
+        return 1;
+    }
+    
+    // Display program header and welcome information
+    printf("IP Address Validator\n");
+    printf("====================\n\n");
+    
+    // Main program loop - continues until user chooses to exit
+    do {
+        // Prompt user to enter an IP address for validation
+        // The reader uses read(), which unlike stdio input does not flush the prompt
+        printf("Enter an IP address to validate: ");
+        fflush(stdout);
+        
+        kind = line_reader_next(&reader, &line, &len);
+        if (kind == LINE_END) {
+            // End of input: there is nothing left to validate or to answer with
+            printf(reader.error ? "Error reading input.\n\n" : "\n\n");
+            break;
+        }
+        
+        // Call our validation function to check if the IP is valid
+        // The slice is validated in place, asking for the reason in case it is
+        // not; a line longer than the buffer is judged on its first part
+        size_t pos;
+        enum ipv4_error err = parse_ipv4_ex(line, len, NULL, &pos);
+        int result = err == IPV4_OK;
+        
+        // Display the validation result to the user
+        // Show both the input (shortened if it did not fit) and whether it's valid or invalid
+        if (kind == LINE_PIECE) {
+            printf("Result: '%.40s...' is INVALID\n", line);
+        } else {
+            printf("Result: '%.*s' is %s\n", (int)len, line, result ? "VALID" : "INVALID");
+        }
+        
+        // If the IP is invalid, say what is wrong with it and where,
+        // then provide helpful information about the correct format
+        if (!result) {
+            printf("Reason: %s (at position %zu)\n", ipv4_error_string(err), pos);
+            printf("Note: Valid IPv4 format is xxx.xxx.xxx.xxx where each xxx is 0-255\n");
+            printf("      Examples: 192.168.1.1, 10.0.0.1, 255.255.255.0\n");
+            printf("      Invalid examples: 256.1.1.1, 192.168.01.1, 192.168.1\n");
+        }
+        if (kind == LINE_PIECE) {
+            line_reader_skip(&reader);  // The rest of an over-long line is never looked at
+        }
+        
+        // Ask user if they want to validate another IP address
+        printf("\nDo you want to validate another IP address? (y/n): ");
+        fflush(stdout);
+        
+        // The answer is the first non-blank character, like scanf(" %c"), but
+        // the rest of its line goes with it; the end of input means no
+        choice = 'n';
+        while ((kind = line_reader_next(&reader, &line, &len)) != LINE_END) {
+            size_t i = 0;
+            while (i < len && isspace((unsigned char)line[i])) {
+                i++;
+            }
+            if (i < len) {
+                choice = line[i];
+                if (kind == LINE_PIECE) {
+                    line_reader_skip(&reader);
+                }
+                break;
+            }
+        }
+        
+        // Add spacing for better readability
+        printf("\n");
+        
+    // Continue the loop if user entered 'y' or 'Y' (case-insensitive)
+    } while (choice == 'y' || choice == 'Y');
+    
+    // Display goodbye message when user chooses to exit
+    printf("Thank you for using the IP Address Validator!\n");
+    
+    // Return 0 to indicate successful program completion
+    line_reader_free(&reader);
+    return 0;
+}
+
+/*
+ * Non-interactive modes
+ * 
+ * These read newline-delimited candidates and write one compact result per
+ * input line, so the tool can sit in a pipeline. Input is pulled in with large
+ * reads and lines are located with memchr() (see the line reader above);
+ * output is collected in a large buffer and written with fwrite(), never one
+ * printf() per line.
+ */
+
+// Size of the input and output buffers used by the non-interactive modes
+#define STREAM_BUFFER_SIZE (1 << 20)
+
+// What the non-interactive modes write for every input line
+enum stream_output {
+    OUTPUT_RESULTS,  // "1" or "0" on its own line, one per input line
+    OUTPUT_VALID,    // only the input lines that are valid addresses
+    OUTPUT_INVALID,  // only the input lines that are not valid addresses
+    OUTPUT_EXTRACT,  // "offset<TAB>address" for every address found anywhere in the input
+    OUTPUT_BINARY    // validity bitmap and address column, see struct binary_block_header
+};
+
+/*
+ * Binary output (--binary)
+ * 
+ * A struct binary_file_header, then any number of blocks. Each block is a
+ * struct binary_block_header followed by two buffers covering the block's
+ * count input lines in order:
+ * 
+ *   validity  bit (i % 8) of byte (i / 8) is set when line i is valid
+ *   values    one uint32_t per line, the packed address (0 for invalid lines)
+ * 
+ * Every buffer starts on a 64-byte file offset and is zero-padded to a
+ * multiple of 64 bytes, and all integers are in the writer's byte order
+ * (check byte_order). That is the memory layout of an Arrow uint32 array, so
+ * a mapped file can be wrapped block by block with no parsing or copying,
+ * e.g. pyarrow.Array.from_buffers(pa.uint32(), count, [validity, values]).
+ * The Arrow IPC metadata itself is not written.
+ */
+#define BINARY_ALIGN 64
+#define BINARY_BLOCK_LINES 65536  // Lines per block; blocks can be shorter
+
+struct binary_file_header {
+    char magic[8];         // "VALIDIP\0"
+    uint32_t byte_order;   // 0x01020304 in the writer's byte order
+    uint32_t version;      // 1
+    uint8_t reserved[48];
+};
+
+struct binary_block_header {
+    uint32_t magic;          // BINARY_BLOCK_MAGIC
+    uint32_t header_size;    // sizeof(struct binary_block_header), 64
+    uint64_t count;          // Lines in this block
+    uint64_t valid;          // Set bits in the validity buffer
+    uint64_t validity_size;  // Bytes of the validity buffer, including padding
+    uint64_t values_size;    // Bytes of the values buffer, including padding
+    uint8_t reserved[24];
+};
+
+#define BINARY_BLOCK_MAGIC 0x4B4C4256u  // "VBLK" read as little-endian bytes
+
+_Static_assert(sizeof(struct binary_file_header) == BINARY_ALIGN, "file header must keep buffers aligned");
+_Static_assert(sizeof(struct binary_block_header) == BINARY_ALIGN, "block header must keep buffers aligned");
+
+// Lines collected for the block being built
+struct binary_block {
+    uint64_t count;
+    uint64_t valid;
+    uint8_t validity[BINARY_BLOCK_LINES / 8];
+    uint32_t values[BINARY_BLOCK_LINES];
+};
+
+// Buffered writer used instead of per-line stdio calls
+// With a NULL stream it collects everything in memory, growing as needed
+struct out_buffer {
+    FILE* f;       // Destination stream, or NULL to collect in memory
+    char* data;    // Pending bytes
+    size_t len;    // Number of pending bytes
+    size_t cap;    // Size of data
+    int failed;    // Set once a write to f (or growing data) has failed
+    struct binary_block* block;  // Block being built in OUTPUT_BINARY mode, allocated on first use
+    struct aggregate* agg;       // Sketches fed every valid address, or NULL (see struct aggregate)
+};
+
+static void out_flush(struct out_buffer* ob) {
+    if (ob->len > 0 && fwrite(ob->data, 1, ob->len, ob->f) != ob->len) {
+        ob->failed = 1;
+    }
+    ob->len = 0;
+}
+
+static void out_write(struct out_buffer* ob, const char* p, size_t n) {
+    if (ob->len + n > ob->cap) {
+        if (ob->f == NULL) {
+            // In-memory buffer: grow geometrically so appends stay amortized O(1)
+            size_t cap = ob->cap * 2 > ob->len + n ? ob->cap * 2 : ob->len + n;
+            char* data = realloc(ob->data, cap);
+            if (data == NULL) {
+                ob->failed = 1;
+                return;
+            }
+            ob->data = data;
+            ob->cap = cap;
+        } else {
+            out_flush(ob);
+            // Anything bigger than the whole buffer goes straight through
+            if (n > ob->cap) {
+                if (fwrite(p, 1, n, ob->f) != n) {
+                    ob->failed = 1;
+                }
+                return;
+            }
+        }
+    }
+    memcpy(ob->data + ob->len, p, n);
+    ob->len += n;
+}
+
+static void binary_write_file_header(struct out_buffer* ob) {
+    struct binary_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "VALIDIP", 8);
+    h.byte_order = 0x01020304u;
+    h.version = 1;
+    out_write(ob, (const char*)&h, sizeof(h));
+}
+
+// Writes out the block being built, if it has any lines, and starts a new one
+static void binary_flush(struct out_buffer* ob) {
+    struct binary_block* b = ob->block;
+    if (b == NULL || b->count == 0) {
+        return;
+    }
+    static const char zeros[BINARY_ALIGN];
+    size_t validity = (size_t)(b->count + 7) / 8;
+    size_t values = (size_t)b->count * sizeof(uint32_t);
+    struct binary_block_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = BINARY_BLOCK_MAGIC;
+    h.header_size = sizeof(h);
+    h.count = b->count;
+    h.valid = b->valid;
+    h.validity_size = (validity + BINARY_ALIGN - 1) & ~(size_t)(BINARY_ALIGN - 1);
+    h.values_size = (values + BINARY_ALIGN - 1) & ~(size_t)(BINARY_ALIGN - 1);
+    out_write(ob, (const char*)&h, sizeof(h));
+    out_write(ob, (const char*)b->validity, validity);
+    out_write(ob, zeros, (size_t)h.validity_size - validity);
+    out_write(ob, (const char*)b->values, values);
+    out_write(ob, zeros, (size_t)h.values_size - values);
+    b->count = 0;
+    b->valid = 0;
+}
+
+// Adds one line's result to the block being built
+static void binary_append(struct out_buffer* ob, int valid, uint32_t addr) {
+    struct binary_block* b = ob->block;
+    if (b == NULL) {
+        b = ob->block = malloc(sizeof(*b));
+        if (b == NULL) {
+            ob->failed = 1;
+            return;
+        }
+        b->count = 0;
+        b->valid = 0;
+    }
+    size_t i = (size_t)b->count;
+    if (i % 8 == 0) {
+        b->validity[i / 8] = 0;
+    }
+    b->validity[i / 8] |= (uint8_t)((valid != 0) << (i % 8));
+    b->values[i] = addr;
+    b->valid += valid != 0;
+    if (++b->count == BINARY_BLOCK_LINES) {
+        binary_flush(ob);
+    }
+}
+
+/*
+ * Aggregation (--distinct, --top)
+ * 
+ * Counting fused into validation: every valid address goes into a
+ * HyperLogLog and a space-saving top-K sketch right after it is parsed, so
+ * no second pass over the output is needed. The multi-threaded modes give
+ * each worker (--mmap) or ring slot (--pipeline, whose slots are only ever
+ * handled by one worker at a time) its own shard and merge the shards when
+ * the input is done, so the hot path takes no locks. Shards are tied to the
+ * input position rather than to thread scheduling, so the result is
+ * reproducible.
+ */
+
+// Largest --top value: the sketch cannot rank more counters than it keeps
+#define AGGREGATE_MAX_TOP IPV4_TOPK_CAPACITY
+
+struct aggregate {
+    int ranked;               // Whether the top-K sketch is kept (--top), the costlier of the two
+    struct ipv4_hll distinct;
+    struct ipv4_topk top;
+};
+
+// Allocates n empty shards, NULL when out of memory
+static struct aggregate* aggregate_create(size_t n, int ranked) {
+    struct aggregate* agg = malloc(n * sizeof(*agg));
+    for (size_t i = 0; agg != NULL && i < n; i++) {
+        agg[i].ranked = ranked;
+        ipv4_hll_init(&agg[i].distinct);
+        ipv4_topk_init(&agg[i].top);
+    }
+    return agg;
+}
+
+static inline void aggregate_add(struct aggregate* agg, uint32_t addr) {
+    ipv4_hll_add(&agg->distinct, addr);
+    if (agg->ranked) {
+        ipv4_topk_add(&agg->top, addr);
+    }
+}
+
+// Folds n shards into dst
+static void aggregate_merge(struct aggregate* dst, const struct aggregate* shards, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ipv4_hll_merge(&dst->distinct, &shards[i].distinct);
+        if (dst->ranked) {
+            ipv4_topk_merge(&dst->top, &shards[i].top);
+        }
+    }
+}
+
+/*
+ * Writes the results for --distinct ("distinct N", an estimate) and --top
+ * ("top ADDRESS COUNT ERROR" per address, most frequent first; the true count
+ * is between COUNT - ERROR and COUNT)
+ */
+static void print_aggregate(FILE* f, const struct aggregate* agg, int distinct, size_t top) {
+    if (distinct) {
+        fprintf(f, "distinct %llu\n", (unsigned long long)ipv4_hll_count(&agg->distinct));
+    }
+    struct ipv4_topk_entry entries[AGGREGATE_MAX_TOP];
+    size_t n = ipv4_topk_result(&agg->top, entries, top);
+    for (size_t i = 0; i < n; i++) {
+        char text[IPV4_FORMAT_SIZE];
+        format_ipv4(entries[i].addr, text);
+        fprintf(f, "top %s %llu %llu\n", text, (unsigned long long)entries[i].count,
+                (unsigned long long)entries[i].error);
+    }
+}
+
+/*
+ * Validates one complete line (without its newline) and writes whatever the
+ * selected mode wants for it. The newline is always written back, even if the
+ * input's last line had none.
+ */
+static void emit_line(struct out_buffer* ob, enum stream_output mode,
+                      const char* line, size_t len) {
+    uint32_t addr = 0;
+    int valid = parse_ipv4(line, len, &addr);
+    if (valid && ob->agg != NULL) {
+        aggregate_add(ob->agg, addr);
+    }
+    switch (mode) {
+    case OUTPUT_RESULTS:
+        out_write(ob, valid ? "1\n" : "0\n", 2);
+        break;
+    case OUTPUT_VALID:
+    case OUTPUT_INVALID:
+        if (valid == (mode == OUTPUT_VALID)) {
+            out_write(ob, line, len);
+            out_write(ob, "\n", 1);
+        }
+        break;
+    case OUTPUT_EXTRACT:
+        break;  // Extraction ignores line structure, see extract_block()
+    case OUTPUT_BINARY:
+        binary_append(ob, valid, addr);
+        break;
+    }
+}
+
+/*
+ * Writes "offset<TAB>address" for every address in p[0..n), where base is the
+ * input offset of p. Offsets are formatted by hand to keep printf() off the
+ * per-match path.
+ */
+static void extract_block(struct out_buffer* ob, const char* p, size_t n, uint64_t base) {
+    struct ipv4_match m;
+    size_t pos = 0;
+    while (ipv4_find_next(p, n, &pos, &m)) {
+        char num[24];
+        size_t k = sizeof(num);
+        uint64_t v = base + m.offset;
+        num[--k] = '\t';
+        do {
+            num[--k] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        out_write(ob, num + k, sizeof(num) - k);
+        out_write(ob, p + m.offset, m.length);
+        out_write(ob, "\n", 1);
+        if (ob->agg != NULL) {
+            aggregate_add(ob->agg, m.addr);
+        }
+    }
+}
+
+/**
+ * Function: run_extract
+ * Purpose: Writes every address embedded anywhere in a stream, with its byte offset
+ * 
+ * Works on raw buffers rather than lines: each buffer is scanned up to its last
+ * character that cannot belong to an address, and the unfinished run after it
+ * is carried into the next read so no address is ever split.
+ * 
+ * Parameter: in  - stream to search
+ * Parameter: out - stream to write matches to
+ * Parameter: agg - sketches to count the matches in, or NULL
+ * Returns: 0 on success, 1 on a read or write error
+ */
+static int run_extract(FILE* in, FILE* out, struct aggregate* agg) {
+    char* buf = malloc(STREAM_BUFFER_SIZE);
+    struct out_buffer ob = { out, malloc(STREAM_BUFFER_SIZE), 0, STREAM_BUFFER_SIZE, 0, NULL, agg };
+    if (buf == NULL || ob.data == NULL) {
+        free(buf);
+        free(ob.data);
+        fprintf(stderr, "validate-ip: out of memory\n");
+        return 1;
+    }
+    
+    uint64_t base = 0;   // Input offset of buf[0]
+    size_t have = 0;     // Bytes of an unfinished run kept at the start of buf
+    int in_run = 0;      // Set while skipping the rest of a run longer than buf
+    
+    for (;;) {
+        size_t got = fread(buf + have, 1, STREAM_BUFFER_SIZE - have, in);
+        have += got;
+        
+        // The tail of a run that already filled a whole buffer cannot be an address
+        size_t from = 0;
+        if (in_run) {
+            while (from < have && ipv4_is_addr_char((unsigned char)buf[from])) {
+                from++;
+            }
+            in_run = from == have && got != 0;
+        }
+        
+        // Scan up to the last byte that ends a run, unless this is the end of input
+        size_t cut = have;
+        if (got != 0) {
+            while (cut > from && ipv4_is_addr_char((unsigned char)buf[cut - 1])) {
+                cut--;
+            }
+        }
+        if (cut == from && got != 0 && have == STREAM_BUFFER_SIZE) {
+            // One run fills the whole buffer: drop it and skip the rest of it
+            in_run = 1;
+            cut = have;
+        } else {
+            extract_block(&ob, buf + from, cut - from, base + from);
+        }
+        
+        // Keep the unfinished run for the next read
+        memmove(buf, buf + cut, have - cut);
+        base += cut;
+        have -= cut;
+        
+        if (got == 0) {
+            break;  // End of input (or a read error, checked below)
+        }
+    }
+    
+    out_flush(&ob);
+    int status = 0;
+    if (ferror(in)) {
+        fprintf(stderr, "validate-ip: error reading input\n");
+        status = 1;
+    }
+    if (ob.failed || fflush(out) != 0) {
+        fprintf(stderr, "validate-ip: error writing output\n");
+        status = 1;
+    }
+    free(buf);
+    free(ob.data);
+    free(ob.block);
+    return status;
+}
+
+/**
+ * Function: run_stream
+ * Purpose: Validates every line of a stream and writes compact results
+ * 
+ * Lines longer than the input buffer cannot be addresses; they are reported as
+ * invalid and passed through piece by piece rather than being buffered whole.
+ * 
+ * Parameter: in   - stream to read newline-delimited candidates from
+ * Parameter: out  - stream to write results to
+ * Parameter: mode - what to write for each line
+ * Parameter: agg  - sketches to count the valid addresses in, or NULL
+ * Returns: 0 on success, 1 on a read or write error
+ */
+static int run_stream(FILE* in, FILE* out, enum stream_output mode, struct aggregate* agg) {
+    struct line_reader reader;
+    int have_reader = line_reader_init(&reader, in, STREAM_BUFFER_SIZE);
+    struct out_buffer ob = { out, malloc(STREAM_BUFFER_SIZE), 0, STREAM_BUFFER_SIZE, 0, NULL, agg };
+    if (!have_reader || ob.data == NULL) {
+        if (have_reader) {
+            line_reader_free(&reader);
+        }
+        free(ob.data);
+        fprintf(stderr, "validate-ip: out of memory\n");
+        return 1;
+    }
+    
+    if (mode == OUTPUT_BINARY) {
+        binary_write_file_header(&ob);
+    }
+    
+    const char* line;
+    size_t len;
+    enum line_kind kind;
+    while ((kind = line_reader_next(&reader, &line, &len)) != LINE_END) {
+        if (kind == LINE_COMPLETE) {
+            emit_line(&ob, mode, line, len);
+            continue;
+        }
+        
+        // A line longer than the buffer can never be valid
+        if (mode == OUTPUT_INVALID) {
+            // Passed through piece by piece rather than being buffered whole
+            do {
+                out_write(&ob, line, len);
+            } while ((kind = line_reader_next(&reader, &line, &len)) == LINE_PIECE);
+            if (kind == LINE_COMPLETE) {
+                out_write(&ob, line, len);
+            }
+            out_write(&ob, "\n", 1);
+            continue;
+        }
+        line_reader_skip(&reader);
+        if (mode == OUTPUT_RESULTS) {
+            out_write(&ob, "0\n", 2);
+        } else if (mode == OUTPUT_BINARY) {
+            binary_append(&ob, 0, 0);
+        }
+    }
+    binary_flush(&ob);
+    
+    out_flush(&ob);
+    int status = 0;
+    if (reader.error) {
+        fprintf(stderr, "validate-ip: error reading input\n");
+        status = 1;
+    }
+    if (ob.failed || fflush(out) != 0) {
+        fprintf(stderr, "validate-ip: error writing output\n");
+        status = 1;
+    }
+    line_reader_free(&reader);
+    free(ob.data);
+    free(ob.block);
+    return status;
+}
+
+#ifdef VALIDATE_IP_HAVE_MMAP
+
+// Bytes of the mapping each worker thread handles per round
+#define MMAP_CHUNK_SIZE (8 << 20)
+
+// One worker's share of a round: a run of whole lines and the output it produced
+struct mmap_job {
+    const char* begin;        // First byte of the first line
+    const char* end;          // One past the last byte (after a newline, or end of file)
+    uint64_t base;            // File offset of begin, for --extract output
+    enum stream_output mode;  // What to write for each line
+    struct out_buffer out;    // Collected output, written by the main thread in order
+};
+
+static void* mmap_worker(void* arg) {
+    struct mmap_job* job = arg;
+    const char* p = job->begin;
+    
+    // Newlines end runs too, so line-aligned chunks never split an address
+    if (job->mode == OUTPUT_EXTRACT) {
+        extract_block(&job->out, p, (size_t)(job->end - p), job->base);
+        return NULL;
+    }
+    
+    while (p < job->end) {
+        const char* nl = memchr(p, '\n', (size_t)(job->end - p));
+        const char* line_end = nl != NULL ? nl : job->end;  // Last line may lack a newline
+        size_t len = (size_t)(line_end - p);
+        emit_line(&job->out, job->mode, p, len);
+        p = line_end + 1;
+    }
+    binary_flush(&job->out);  // Each chunk ends its own blocks
+    return NULL;
+}
+
+/*
+ * End of a worker's share: the byte after the first newline at or after the
+ * nominal end, so that no line is ever split between two workers.
+ */
+static const char* mmap_line_end(const char* nominal, const char* limit) {
+    if (nominal >= limit) {
+        return limit;
+    }
+    const char* nl = memchr(nominal, '\n', (size_t)(limit - nominal));
+    return nl != NULL ? nl + 1 : limit;
+}
+
+/**
+ * Function: run_mmap
+ * Purpose: Validates every line of a file using all cores
+ * 
+ * The file is mapped read-only and processed in rounds. Each round hands one
+ * line-aligned chunk to each worker thread, the workers validate their lines
+ * into private buffers, and the main thread writes those buffers out in file
+ * order, so the text output is identical to run_stream() on the same file.
+ * With --binary the rows are the same too, but every chunk ends its own
+ * blocks, so the block boundaries differ.
+ * Pages of finished rounds are released again so memory use stays bounded.
+ * 
+ * Parameter: path    - file to validate
+ * Parameter: out     - stream to write results to
+ * Parameter: mode    - what to write for each line
+ * Parameter: threads - number of worker threads (at least 1)
+ * Parameter: agg     - sketches to count the valid addresses in, or NULL
+ * Returns: 0 on success, 1 on an I/O or resource error
+ */
+static int run_mmap(const char* path, FILE* out, enum stream_output mode, long threads,
+                    struct aggregate* agg) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "validate-ip: cannot open '%s'\n", path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "validate-ip: cannot stat '%s'\n", path);
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (mode == OUTPUT_BINARY) {
+        // Written before any block, so even an empty file gives a valid stream
+        struct out_buffer header = { out, NULL, 0, 0, 0, NULL, NULL };
+        binary_write_file_header(&header);
+        if (header.failed) {
+            fprintf(stderr, "validate-ip: error writing output\n");
+            close(fd);
+            return 1;
+        }
+    }
+    if (size == 0) {
+        close(fd);
+        return 0;  // Nothing to validate (and an empty mapping is an error)
+    }
+    
+    char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file contents reachable
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "validate-ip: cannot map '%s'\n", path);
+        return 1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    
+    struct mmap_job* jobs = calloc((size_t)threads, sizeof(*jobs));
+    pthread_t* tids = calloc((size_t)threads, sizeof(*tids));
+    int* started = calloc((size_t)threads, sizeof(*started));
+    struct aggregate* shards = agg != NULL ? aggregate_create((size_t)threads, agg->ranked) : NULL;  // One per worker
+    int status = 0;
+    if (jobs == NULL || tids == NULL || started == NULL || (agg != NULL && shards == NULL)) {
+        fprintf(stderr, "validate-ip: out of memory\n");
+        status = 1;
+    }
+    for (long t = 0; status == 0 && shards != NULL && t < threads; t++) {
+        jobs[t].out.agg = &shards[t];
+    }
+    
+    const char* limit = map + size;
+    const char* cursor = map;
+    while (status == 0 && cursor < limit) {
+        const char* round_begin = cursor;
+        
+        // Carve the next round into line-aligned chunks and start a worker on each
+        for (long t = 0; t < threads; t++) {
+            struct mmap_job* job = &jobs[t];
+            job->begin = cursor;
+            job->end = mmap_line_end(cursor + ((size_t)(limit - cursor) < MMAP_CHUNK_SIZE
+                                               ? (size_t)(limit - cursor) : MMAP_CHUNK_SIZE),
+                                     limit);
+            job->base = (uint64_t)(cursor - map);
+            job->mode = mode;
+            job->out.len = 0;
+            cursor = job->end;
+            
+            // Chunk 0 runs on this thread; if a thread cannot be created, run it here too
+            started[t] = t > 0 && job->begin < job->end &&
+                         pthread_create(&tids[t], NULL, mmap_worker, job) == 0;
+        }
+        mmap_worker(&jobs[0]);
+        for (long t = 1; t < threads; t++) {
+            if (started[t]) {
+                pthread_join(tids[t], NULL);
+            } else {
+                mmap_worker(&jobs[t]);
+            }
+        }
+        
+        // Write the round out in file order
+        for (long t = 0; t < threads; t++) {
+            if (jobs[t].out.failed) {
+                fprintf(stderr, "validate-ip: out of memory\n");
+                status = 1;
+                break;
+            }
+            if (jobs[t].out.len > 0 && fwrite(jobs[t].out.data, 1, jobs[t].out.len, out) != jobs[t].out.len) {
+                fprintf(stderr, "validate-ip: error writing output\n");
+                status = 1;
+                break;
+            }
+        }
+        
+        // The round's input pages are not needed again
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t drop_begin = (uintptr_t)round_begin & ~(page - 1);
+        uintptr_t drop_end = (uintptr_t)cursor & ~(page - 1);
+        if (drop_end > drop_begin) {
+            madvise((void*)drop_begin, drop_end - drop_begin, MADV_DONTNEED);
+        }
+    }
+    
+    if (status == 0 && fflush(out) != 0) {
+        fprintf(stderr, "validate-ip: error writing output\n");
+        status = 1;
+    }
+    if (status == 0 && shards != NULL) {
+        aggregate_merge(agg, shards, (size_t)threads);
+    }
+    free(shards);
+    if (jobs != NULL) {
+        for (long t = 0; t < threads; t++) {
+            free(jobs[t].out.data);
+            free(jobs[t].out.block);
+        }
+    }
+    free(jobs);
+    free(tids);
+    free(started);
+    munmap(map, size);
+    return status;
+}
+
+/*
+ * Pipelined ingestion (--pipeline)
+ * 
+ * A reader thread fills a ring of large buffers with read(2), a pool of
+ * workers validates filled buffers into private output buffers, and a writer
+ * thread writes those out strictly in input order. Reads, parsing and writes
+ * of different buffers overlap, so the CPUs keep working while the next read
+ * is still waiting on slow storage or the network.
+ * 
+ * Every buffer is cut after its last line break (for --extract, after its
+ * last byte that cannot be part of an address) and the unfinished rest is
+ * carried to the start of the next buffer, so no line or address is split.
+ */
+
+// Bytes read into each buffer
+#define PIPELINE_BUFFER_SIZE (4 << 20)
+
+// One slot of the ring
+enum pipeline_state {
+    SLOT_FREE,    // Waiting for the reader
+    SLOT_FILLED,  // Waiting for a worker
+    SLOT_BUSY,    // Being validated
+    SLOT_DONE     // Waiting for the writer
+};
+
+struct pipeline_slot {
+    enum pipeline_state state;
+    char* data;               // PIPELINE_BUFFER_SIZE bytes of input
+    size_t len;               // Bytes of data that belong to this job
+    uint64_t base;            // Input offset of data[0], for --extract output
+    int continues;            // Starts inside a line (or run) too long for one buffer
+    int last;                 // Last job of the input
+    struct out_buffer out;    // Output of this job
+};
+
+struct pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;   // Broadcast on every slot state change
+    struct pipeline_slot* slots;
+    size_t depth;             // Number of slots
+    uint64_t filled;          // Jobs published by the reader
+    uint64_t taken;           // Jobs claimed by workers
+    uint64_t written;         // Jobs written out
+    int done;                 // Reader has published its last job
+    int failed;               // Set on a write error; everybody stops
+    enum stream_output mode;
+    FILE* out;
+};
+
+// Validates one job, see struct pipeline_slot
+static void pipeline_run_job(struct pipeline_slot* slot, enum stream_output mode) {
+    const char* p = slot->data;
+    const char* end = p + slot->len;
+    struct out_buffer* ob = &slot->out;
+    ob->len = 0;
+    
+    if (mode == OUTPUT_EXTRACT) {
+        // The tail of an overlong run cannot be an address
+        if (slot->continues) {
+            while (p < end && ipv4_is_addr_char((unsigned char)*p)) {
+                p++;
+            }
+        }
+        extract_block(ob, p, (size_t)(end - p), slot->base + (uint64_t)(p - slot->data));
+        return;
+    }
+    
+    if (slot->continues) {
+        // Finish a line that was too long to ever be valid, as run_stream() does
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* piece = nl != NULL ? nl + 1 : end;
+        if (mode == OUTPUT_INVALID) {
+            out_write(ob, p, (size_t)(piece - p));
+        }
+        if (nl != NULL || slot->last) {
+            if (mode == OUTPUT_INVALID && nl == NULL) {
+                out_write(ob, "\n", 1);
+            } else if (mode == OUTPUT_RESULTS) {
+                out_write(ob, "0\n", 2);
+            } else if (mode == OUTPUT_BINARY) {
+                binary_append(ob, 0, 0);
+            }
+        }
+        p = piece;
+    }
+    
+    while (p < end) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* line_end = nl != NULL ? nl : end;  // Last line may lack a newline
+        emit_line(ob, mode, p, (size_t)(line_end - p));
+        p = line_end + 1;
+    }
+    binary_flush(ob);
+}
+
+static void* pipeline_worker(void* arg) {
+    struct pipeline* pl = arg;
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        while (!pl->failed && pl->taken == pl->filled && !pl->done) {
+            pthread_cond_wait(&pl->changed, &pl->lock);
+        }
+        if (pl->failed || pl->taken == pl->filled) {
+            break;  // Stopped, or every job has been claimed
+        }
+        struct pipeline_slot* slot = &pl->slots[pl->taken++ % pl->depth];
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pl->lock);
+        
+        pipeline_run_job(slot, pl->mode);
+        
+        pthread_mutex_lock(&pl->lock);
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&pl->changed);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+static void* pipeline_writer(void* arg) {
+    struct pipeline* pl = arg;
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        struct pipeline_slot* slot = &pl->slots[pl->written % pl->depth];
+        while (!pl->failed && !(pl->written < pl->filled && slot->state == SLOT_DONE) &&
+               !(pl->done && pl->written == pl->filled)) {
+            pthread_cond_wait(&pl->changed, &pl->lock);
+        }
+        if (pl->failed || pl->written == pl->filled) {
+            break;  // Stopped, or everything has been written
+        }
+        pthread_mutex_unlock(&pl->lock);
+        
+        int ok = slot->out.failed == 0 &&
+                 (slot->out.len == 0 || fwrite(slot->out.data, 1, slot->out.len, pl->out) == slot->out.len);
+        
+        pthread_mutex_lock(&pl->lock);
+        if (!ok) {
+            pl->failed = 1;
+        }
+        slot->state = SLOT_FREE;
+        pl->written++;
+        pthread_cond_broadcast(&pl->changed);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+/*
+ * Where a buffer of len bytes is cut: just after its last line break (or last
+ * byte that ends an address run, for --extract), 0 if there is none
+ */
+static size_t pipeline_cut(const char* data, size_t len, enum stream_output mode) {
+    size_t cut = len;
+    if (mode == OUTPUT_EXTRACT) {
+        while (cut > 0 && ipv4_is_addr_char((unsigned char)data[cut - 1])) {
+            cut--;
+        }
+    } else {
+        while (cut > 0 && data[cut - 1] != '\n') {
+            cut--;
+        }
+    }
+    return cut;
+}
+
+/**
+ * Function: run_pipeline
+ * Purpose: Validates a stream with overlapped reads, parsing and writes
+ * 
+ * The text output is identical to run_stream() (or run_extract()) on the same
+ * input. With --binary the rows are the same, but every slot ends its own
+ * blocks, so the block boundaries differ.
+ * 
+ * Parameter: fd      - file descriptor to read from
+ * Parameter: out     - stream to write results to
+ * Parameter: mode    - what to write for each line
+ * Parameter: threads - number of worker threads (at least 1)
+ * Parameter: agg     - sketches to count the valid addresses in, or NULL
+ * Returns: 0 on success, 1 on an I/O or resource error
+ */
+static int run_pipeline(int fd, FILE* out, enum stream_output mode, long threads,
+                        struct aggregate* agg) {
+    struct pipeline pl;
+    memset(&pl, 0, sizeof(pl));
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.changed, NULL);
+    pl.mode = mode;
+    pl.out = out;
+    pl.depth = (size_t)threads + 3;  // One buffer per worker, plus one each being read and written, plus one spare
+    pl.slots = calloc(pl.depth, sizeof(*pl.slots));
+    pthread_t* workers = calloc((size_t)threads, sizeof(*workers));
+    struct aggregate* shards = agg != NULL ? aggregate_create(pl.depth, agg->ranked) : NULL;  // One per slot
+    int status = 0;
+    if (pl.slots == NULL || workers == NULL || (agg != NULL && shards == NULL)) {
+        status = 1;
+    }
+    for (size_t s = 0; status == 0 && s < pl.depth; s++) {
+        pl.slots[s].data = malloc(PIPELINE_BUFFER_SIZE);
+        pl.slots[s].out.agg = shards != NULL ? &shards[s] : NULL;
+        status = pl.slots[s].data == NULL;
+    }
+    if (status != 0) {
+        fprintf(stderr, "validate-ip: out of memory\n");
+    }
+    
+    if (status == 0 && mode == OUTPUT_BINARY) {
+        struct out_buffer header = { out, NULL, 0, 0, 0, NULL, NULL };
+        binary_write_file_header(&header);
+        if (header.failed) {
+            fprintf(stderr, "validate-ip: error writing output\n");
+            status = 1;
+        }
+    }
+    
+    long started = 0;
+    pthread_t writer;
+    int writer_started = 0;
+    if (status == 0) {
+        writer_started = pthread_create(&writer, NULL, pipeline_writer, &pl) == 0;
+        while (started < threads && pthread_create(&workers[started], NULL, pipeline_worker, &pl) == 0) {
+            started++;
+        }
+        if (!writer_started || started == 0) {
+            fprintf(stderr, "validate-ip: cannot start threads\n");
+            status = 1;
+            pthread_mutex_lock(&pl.lock);
+            pl.failed = 1;
+            pthread_cond_broadcast(&pl.changed);
+            pthread_mutex_unlock(&pl.lock);
+        }
+    }
+    
+    // This thread is the reader
+    uint64_t base = 0;     // Input offset of the next buffer's first byte
+    size_t carry = 0;      // Bytes carried over to the next buffer
+    int continues = 0;     // The next buffer starts inside an overlong line
+    int read_error = 0;
+    for (uint64_t seq = 0; status == 0; seq++) {
+        struct pipeline_slot* slot = &pl.slots[seq % pl.depth];
+        pthread_mutex_lock(&pl.lock);
+        while (!pl.failed && slot->state != SLOT_FREE) {
+            pthread_cond_wait(&pl.changed, &pl.lock);
+        }
+        int stop = pl.failed;
+        pthread_mutex_unlock(&pl.lock);
+        if (stop) {
+            break;
+        }
+        
+        // The unfinished end of the previous buffer comes first
+        if (carry > 0) {
+            const struct pipeline_slot* prev = &pl.slots[(seq - 1) % pl.depth];
+            memcpy(slot->data, prev->data + prev->len, carry);
+        }
+        size_t have = carry;
+        ssize_t got = 1;
+        while (have < PIPELINE_BUFFER_SIZE && got > 0) {
+            got = read(fd, slot->data + have, PIPELINE_BUFFER_SIZE - have);
+            if (got > 0) {
+                have += (size_t)got;
+            } else if (got < 0 && errno == EINTR) {
+                got = 1;
+            }
+        }
+        read_error = got < 0;
+        int eof = got <= 0;
+        
+        size_t cut = eof ? have : pipeline_cut(slot->data, have, mode);
+        slot->continues = continues;
+        if (cut == 0 && !eof) {
+            // No line break in a whole buffer: all of it is part of an overlong line
+            cut = have;
+            slot->continues = 1;
+            continues = 1;
+        } else {
+            continues = 0;
+        }
+        slot->len = cut;
+        slot->base = base;
+        slot->last = eof;
+        base += cut;
+        carry = have - cut;
+        
+        pthread_mutex_lock(&pl.lock);
+        slot->state = SLOT_FILLED;
+        pl.filled++;
+        pl.done = eof;
+        pthread_cond_broadcast(&pl.changed);
+        pthread_mutex_unlock(&pl.lock);
+        if (eof) {
+            break;
+        }
+    }
+    
+    for (long t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    if (writer_started) {
+        pthread_join(writer, NULL);
+    }
+    
+    if (read_error) {
+        fprintf(stderr, "validate-ip: error reading input\n");
+        status = 1;
+    }
+    if (status == 0 && (pl.failed || fflush(out) != 0)) {
+        fprintf(stderr, "validate-ip: error writing output\n");
+        status = 1;
+    }
+    if (status == 0 && shards != NULL) {
+        aggregate_merge(agg, shards, pl.depth);
+    }
+    free(shards);
+    if (pl.slots != NULL) {
+        for (size_t s = 0; s < pl.depth; s++) {
+            free(pl.slots[s].data);
+            free(pl.slots[s].out.data);
+            free(pl.slots[s].out.block);
+        }
+    }
+    free(pl.slots);
+    free(workers);
+    pthread_cond_destroy(&pl.changed);
+    pthread_mutex_destroy(&pl.lock);
+    return status;
+}
+
+#endif /* VALIDATE_IP_HAVE_MMAP */
+
+static void print_usage(FILE* f) {
+    fprintf(f,
+            "Usage: validate-ip                  interactive prompt\n"
+            "       validate-ip --stream [OPTION]... [FILE]\n"
+            "       validate-ip --mmap [OPTION]... FILE\n"
+            "       validate-ip --pipeline [OPTION]... [FILE]\n"
+            "\n"
+            "Stream mode reads one candidate address per line from FILE (or standard\n"
+            "input when FILE is missing or \"-\") and writes \"1\" or \"0\" per line.\n"
+            "Mmap mode does the same for a regular file, split across all cores.\n"
+            "Pipeline mode does the same for any file or pipe, overlapping large reads\n"
+            "with validation on all cores and ordered writes.\n"
+            "\n"
+            "  --valid       write only the lines that are valid addresses\n"
+            "  --invalid     write only the lines that are not valid addresses\n"
+            "  --extract     find addresses anywhere in the text and write\n"
+            "                \"OFFSET<TAB>ADDRESS\" for each one\n"
+            "  --binary      write a validity bitmap and uint32 address column per\n"
+            "                block of lines instead of text (64-byte aligned, Arrow layout)\n"
+            "  --threads N   number of worker threads for --mmap and --pipeline\n"
+            "                (default: all cores)\n"
+            "  --stats       write parse counters and latency histogram to standard\n"
+            "                error when done (needs a -DVALIDATE_IP_STATS build)\n"
+            "  --distinct    write the estimated number of distinct valid addresses\n"
+            "                to standard error when done, as \"distinct N\"\n"
+            "  --top N       write the N (at most %d) most frequent valid addresses\n"
+            "                to standard error when done, as \"top ADDRESS COUNT ERROR\"\n"
+            "                (the true count is between COUNT - ERROR and COUNT)\n"
+            "  -h, --help    show this help\n", AGGREGATE_MAX_TOP);
+}
+
+/*
+ * Writes the ipv4_stats_snapshot() totals for --stats, one "name value" pair
+ * per line
+ */
+static void print_stats(FILE* f) {
+    struct ipv4_stats st;
+    ipv4_stats_snapshot(&st);
+    fprintf(f, "calls %llu\naccepts %llu\nbytes %llu\n", (unsigned long long)st.calls,
+            (unsigned long long)st.accepts, (unsigned long long)st.bytes);
+    for (int r = IPV4_ERR_LENGTH; r < IPV4_STATS_REASONS; r++) {
+        fprintf(f, "rejects %llu %s\n", (unsigned long long)st.rejects[r],
+                ipv4_error_string((enum ipv4_error)r));
+    }
+    fprintf(f, "samples %llu\n", (unsigned long long)st.samples);
+    for (int b = 0; b < IPV4_STATS_BUCKETS; b++) {
+        if (st.latency[b] != 0) {
+            fprintf(f, "latency %llu-%llu ticks %llu\n", 1ULL << b, (2ULL << b) - 1,
+                    (unsigned long long)st.latency[b]);
+        }
+    }
+}
+
+/**
+ * Function: main
+ * Purpose: Program entry point; runs the interactive prompt or one of the stream modes
+ * 
+ * Parameter: argc - number of command line arguments
+ * Parameter: argv - command line arguments, see print_usage()
+ * Returns: 0 on success, 1 on I/O errors, 2 on usage errors
+ */
+int main(int argc, char* argv[]) {
+    int stream = 0;                           // Set by --stream
+    int use_mmap = 0;                         // Set by --mmap
+    int pipeline = 0;                         // Set by --pipeline
+    long threads = 0;                         // Set by --threads, 0 means one per core
+    enum stream_output mode = OUTPUT_RESULTS; // Changed by --valid / --invalid / --extract / --binary
+    const char* mode_option = NULL;           // Which of those set mode, for conflict errors
+    const char* path = NULL;                  // Input file, NULL for standard input
+    int stats = 0;                            // Set by --stats
+    int distinct = 0;                         // Set by --distinct
+    long top = 0;                             // Set by --top
+    
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(arg, "--mmap") == 0) {
+            use_mmap = 1;
+        } else if (strcmp(arg, "--pipeline") == 0) {
+            pipeline = 1;
+        } else if (strcmp(arg, "--threads") == 0) {
+            char* end = NULL;
+            threads = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+            if (end == NULL || *end != '\0' || threads < 1 || threads > 1024) {
+                fprintf(stderr, "validate-ip: --threads needs a number between 1 and 1024\n");
+                return 2;
+            }
+        } else if (strcmp(arg, "--valid") == 0 || strcmp(arg, "--invalid") == 0 ||
+                   strcmp(arg, "--extract") == 0 || strcmp(arg, "--binary") == 0) {
+            enum stream_output want = strcmp(arg, "--valid") == 0   ? OUTPUT_VALID
+                                    : strcmp(arg, "--invalid") == 0 ? OUTPUT_INVALID
+                                    : strcmp(arg, "--extract") == 0 ? OUTPUT_EXTRACT
+                                                                    : OUTPUT_BINARY;
+            if (mode_option != NULL && mode != want) {
+                // Each selects a different output; letting the last one win would drop a filter
+                fprintf(stderr, "validate-ip: %s cannot be combined with %s\n", arg, mode_option);
+                return 2;
+            }
+            mode = want;
+            mode_option = arg;
+        } else if (strcmp(arg, "--stats") == 0) {
+            struct ipv4_stats probe;
+            if (!ipv4_stats_snapshot(&probe)) {
+                fprintf(stderr, "validate-ip: --stats needs a library built with -DVALIDATE_IP_STATS\n");
+                return 2;
+            }
+            stats = 1;
+        } else if (strcmp(arg, "--distinct") == 0) {
+            distinct = 1;
+        } else if (strcmp(arg, "--top") == 0) {
+            char* end = NULL;
+            top = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+            if (end == NULL || *end != '\0' || top < 1 || top > AGGREGATE_MAX_TOP) {
+                fprintf(stderr, "validate-ip: --top needs a number between 1 and %d\n", AGGREGATE_MAX_TOP);
+                return 2;
+            }
+        } else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            print_usage(stdout);
+            return 0;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "validate-ip: unknown option '%s'\n", arg);
+            print_usage(stderr);
+            return 2;
+        } else if (path == NULL) {
+            path = arg;
+        } else {
+            fprintf(stderr, "validate-ip: only one input file may be given\n");
+            return 2;
+        }
+    }
+    
+    // The input modes exclude each other, and only the threaded ones have threads
+    if (stream + use_mmap + pipeline > 1) {
+        fprintf(stderr, "validate-ip: only one of --stream, --mmap and --pipeline may be given\n");
+        return 2;
+    }
+    if (threads != 0 && stream) {
+        fprintf(stderr, "validate-ip: --threads requires --mmap or --pipeline\n");
+        return 2;
+    }
+    
+    // One set of sketches for the whole run; the threaded modes merge their shards into it
+    struct aggregate* agg = NULL;
+    if (distinct || top != 0) {
+        agg = aggregate_create(1, top != 0);
+        if (agg == NULL) {
+            fprintf(stderr, "validate-ip: out of memory\n");
+            return 1;
+        }
+    }
+    
+    if (use_mmap) {
+        if (path == NULL || strcmp(path, "-") == 0) {
+            fprintf(stderr, "validate-ip: --mmap needs a regular FILE\n");
+            free(agg);
+            return 2;
+        }
+#ifdef VALIDATE_IP_HAVE_MMAP
+        if (threads == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cores > 0 ? (cores < 1024 ? cores : 1024) : 1;
+        }
+        int status = run_mmap(path, stdout, mode, threads, agg);
+        if (stats) {
+            print_stats(stderr);
+        }
+        if (agg != NULL && status == 0) {
+            print_aggregate(stderr, agg, distinct, (size_t)top);
+        }
+        free(agg);
+        return status;
+#else
+        fprintf(stderr, "validate-ip: --mmap is not supported on this platform\n");
+        free(agg);
+        return 2;
+#endif
+    }
+    
+    if (pipeline) {
+#ifdef VALIDATE_IP_HAVE_MMAP
+        if (threads == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cores > 0 ? (cores < 1024 ? cores : 1024) : 1;
+        }
+        int fd = STDIN_FILENO;
+        if (path != NULL && strcmp(path, "-") != 0) {
+            fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "validate-ip: cannot open '%s'\n", path);
+                free(agg);
+                return 1;
+            }
+        }
+        int status = run_pipeline(fd, stdout, mode, threads, agg);
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        if (stats) {
+            print_stats(stderr);
+        }
+        if (agg != NULL && status == 0) {
+            print_aggregate(stderr, agg, distinct, (size_t)top);
+        }
+        free(agg);
+        return status;
+#else
+        fprintf(stderr, "validate-ip: --pipeline is not supported on this platform\n");
+        free(agg);
+        return 2;
+#endif
+    }
+    
+    // Without --stream keep the original interactive behavior
+    if (!stream) {
+        if (path != NULL || mode != OUTPUT_RESULTS || threads != 0 || stats || agg != NULL) {
+            fprintf(stderr, "validate-ip: FILE, --valid, --invalid, --extract, --binary, --threads, --stats, --distinct and --top require --stream, --mmap or --pipeline\n");
+            free(agg);
+            return 2;
+        }
+        return run_interactive();
+    }
+    
+    FILE* in = stdin;
+    if (path != NULL && strcmp(path, "-") != 0) {
+        in = fopen(path, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "validate-ip: cannot open '%s'\n", path);
+            free(agg);
+            return 1;
+        }
+    }
+    
+    int status = mode == OUTPUT_EXTRACT ? run_extract(in, stdout, agg) : run_stream(in, stdout, mode, agg);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (stats) {
+        print_stats(stderr);
+    }
+    if (agg != NULL && status == 0) {
+        print_aggregate(stderr, agg, distinct, (size_t)top);
+    }
+    free(agg);
+    return status;
+}
+
@@ -0,0 +1,401 @@
+/*
+ * Differential checks shared by the fuzz target and the verification runners
+ *
+ * check_candidate() runs one candidate through every parser variant in
+ * validate-ip.c and compares each verdict (and packed address) against
+ * reference_validate_ip(), the original strtok()-based validate_ip() the fast
+ * engines replaced. It also asks the C library's inet_pton(), whose strict
+ * dotted-quad rules are meant to match ours, and reports any difference from
+ * it separately so it can be looked at without failing the run, and does the
+ * same for parse_ipv6() against inet_pton(AF_INET6). parse_ipv4_aton() is
+ * held to inet_aton() itself, apart from the two documented differences.
+ */
+#ifndef VALIDATE_IP_FUZZ_CHECK_H
+#define VALIDATE_IP_FUZZ_CHECK_H
+
+#include "../validate-ip.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * The variants that are compared, one bit each in the check_candidate() result
+ */
+enum check_engine {
+    CHECK_SCALAR,
+    CHECK_TABLE,
+    CHECK_BRANCHLESS,
+    CHECK_SSSE3,
+    CHECK_NEON,
+    CHECK_DISPATCH,
+    CHECK_VALIDATE_IP,
+    CHECK_VALIDATE_IP_N,
+    CHECK_BATCH,
+    CHECK_CACHE,
+    CHECK_EX,
+    CHECK_PARSE_IP,
+    CHECK_DIALECTS,
+    CHECK_EXTRACT,
+    CHECK_CLASSIFY,
+    CHECK_ATON,
+    CHECK_PTON,       // Not an engine: inet_pton() disagrees with the reference
+    CHECK_PTON6,      // Not an engine: inet_pton(AF_INET6) disagrees with parse_ipv6()
+    CHECK_COUNT
+};
+
+static const char* const check_engine_names[CHECK_COUNT] = {
+    "scalar", "table", "branchless", "ssse3", "neon", "dispatch", "validate_ip", "validate_ip_n",
+    "batch", "cache", "parse_ipv4_ex", "parse_ip", "dialects", "extract", "classify",
+    "inet_aton", "inet_pton", "inet_pton6",
+};
+
+// Bits of the informational inet_pton() comparisons
+#define CHECK_PTON_MASK ((1u << CHECK_PTON) | (1u << CHECK_PTON6))
+
+// All other bits: a disagreement in any of these is a bug
+#define CHECK_ENGINE_MASK ((1u << CHECK_COUNT) - 1 - CHECK_PTON_MASK)
+
+/*
+ * Per-thread state needed by the stateful variants
+ */
+struct check_ctx {
+    struct ipv4_cache* cache;
+    struct ipv4_arena* arena;
+};
+
+/**
+ * Function: reference_validate_ip
+ * Purpose: The original validate_ip(), kept as the oracle for every fast path
+ *
+ * Identical in behavior to the baseline implementation. The only edits make it
+ * safe to run on arbitrary bytes from many threads: strtok_r() instead of
+ * strtok(), an unsigned char cast for isdigit(), and strtol() instead of atoi()
+ * so that over-long digit runs do not overflow.
+ *
+ * Parameter: ip - pointer to null-terminated string containing the IP address to validate
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+static int reference_validate_ip(const char* ip) {
+    if (ip == NULL) {
+        return 0;  // Invalid: null pointer means no string to validate
+    }
+
+    char ip_copy[16];
+    int len = (int)strlen(ip);
+    if (len < 7 || len > 15) {
+        return 0;  // Invalid: string length is outside acceptable bounds
+    }
+    strcpy(ip_copy, ip);
+
+    int dot_count = 0;
+    for (int i = 0; i < len; i++) {
+        if (ip[i] == '.') {
+            dot_count++;
+        } else if (!isdigit((unsigned char)ip[i])) {
+            return 0;  // Invalid: contains non-digit, non-dot character
+        }
+    }
+    if (dot_count != 3) {
+        return 0;  // Invalid: wrong number of dots (too few or too many octets)
+    }
+
+    char* save = NULL;
+    char* token = strtok_r(ip_copy, ".", &save);
+    int octet_count = 0;
+    while (token != NULL && octet_count < 4) {
+        if (strlen(token) == 0) {
+            return 0;  // Invalid: empty octet found
+        }
+        if (strlen(token) > 1 && token[0] == '0') {
+            return 0;  // Invalid: leading zeros not allowed
+        }
+        long num = strtol(token, NULL, 10);
+        if (num < 0 || num > 255) {
+            return 0;  // Invalid: octet value is outside the 0-255 range
+        }
+        char temp[4];
+        snprintf(temp, sizeof(temp), "%ld", num);
+        if (strcmp(temp, token) != 0) {
+            return 0;  // Invalid: conversion mismatch indicates parsing error
+        }
+        token = strtok_r(NULL, ".", &save);
+        octet_count++;
+    }
+    if (octet_count != 4) {
+        return 0;  // Invalid: wrong number of octets processed
+    }
+    return 1;  // Valid IPv4 address
+}
+
+/*
+ * Packed value of an address the reference accepted, worked out independently
+ * of every engine
+ */
+static uint32_t reference_pack(const char* ip) {
+    uint32_t addr = 0, octet = 0;
+    for (; *ip != '\0'; ip++) {
+        if (*ip == '.') {
+            addr = (addr << 8) | octet;
+            octet = 0;
+        } else {
+            octet = octet * 10 + (uint32_t)(*ip - '0');
+        }
+    }
+    return (addr << 8) | octet;
+}
+
+/*
+ * inet_aton() of a C string, reduced to the slice parse_ipv4_aton() is meant to
+ * agree on. inet_aton() stops at the first whitespace and ignores the rest,
+ * while the dialect needs the whole slice to be the address, so *len is cut
+ * there. Returns -1 when inet_aton() accepted a bare "0x" part (some C
+ * libraries read it as 0), which the dialect rejects on purpose; otherwise
+ * its verdict.
+ */
+static int reference_aton(const char* s, size_t* len, uint32_t* addr) {
+    size_t k = strcspn(s, " \t\n\v\f\r");
+    *len = k;
+    struct in_addr in;
+    if (inet_aton(s, &in) == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i + 1 < k; i++) {
+        if ((i == 0 || s[i - 1] == '.') && s[i] == '0' && (s[i + 1] | 0x20) == 'x' &&
+            (i + 2 == k || s[i + 2] == '.')) {
+            return -1;
+        }
+    }
+    *addr = ntohl(in.s_addr);
+    return 1;
+}
+
+/*
+ * Range flags of a packed address, written octet by octet from the RFC tables
+ * rather than from the masks ipv4_classify() uses
+ */
+static unsigned reference_classify(uint32_t addr) {
+    unsigned a = addr >> 24, b = (addr >> 16) & 0xFF, c = (addr >> 8) & 0xFF;
+    unsigned flags = 0;
+    if (a == 10 || (a == 172 && b >= 16 && b <= 31) || (a == 192 && b == 168)) {
+        flags |= IPV4_CLASS_PRIVATE;
+    }
+    if (a == 127) {
+        flags |= IPV4_CLASS_LOOPBACK;
+    }
+    if (a == 169 && b == 254) {
+        flags |= IPV4_CLASS_LINK_LOCAL;
+    }
+    if (a >= 224 && a <= 239) {
+        flags |= IPV4_CLASS_MULTICAST;
+    }
+    if (a == 100 && b >= 64 && b <= 127) {
+        flags |= IPV4_CLASS_CGNAT;
+    }
+    if ((a == 192 && b == 0 && c == 2) || (a == 198 && b == 51 && c == 100) ||
+        (a == 203 && b == 0 && c == 113)) {
+        flags |= IPV4_CLASS_DOCUMENTATION;
+    }
+    if (addr == 0xFFFFFFFF) {
+        flags |= IPV4_CLASS_BROADCAST;
+    }
+    return flags;
+}
+
+// Sets bit engine in *failed when (ok, addr) does not match the expectation
+static inline void check_result(unsigned* failed, enum check_engine engine, int ok,
+                                uint32_t addr, int expect, uint32_t expect_addr) {
+    if ((ok != 0) != expect || (expect && addr != expect_addr)) {
+        *failed |= 1u << engine;
+    }
+}
+
+/**
+ * Function: check_candidate
+ * Purpose: Runs one candidate through every variant and compares with the reference
+ *
+ * Parameter: ctx - per-thread state, see struct check_ctx
+ * Parameter: p   - candidate bytes (any content, need not be null-terminated)
+ * Parameter: n   - number of bytes at p
+ * Returns: bitmask of enum check_engine values that disagreed, 0 if all agree
+ */
+static inline unsigned check_candidate(struct check_ctx* ctx, const char* p, size_t n) {
+    // The reference and inet_pton() need a C string; an embedded '\0' is never valid
+    char copy[64];
+    int has_nul = memchr(p, '\0', n) != NULL;
+    int expect = 0;
+    uint32_t expect_addr = 0;
+    if (!has_nul && n < sizeof(copy)) {
+        memcpy(copy, p, n);
+        copy[n] = '\0';
+        expect = reference_validate_ip(copy);
+        expect_addr = expect ? reference_pack(copy) : 0;
+    }
+
+    unsigned failed = 0;
+    uint32_t addr;
+    int ok;
+
+    addr = 0;
+    ok = parse_ipv4_scalar(p, n, &addr);
+    check_result(&failed, CHECK_SCALAR, ok, addr, expect, expect_addr);
+
+    addr = 0;
+    ok = parse_ipv4_table(p, n, &addr);
+    check_result(&failed, CHECK_TABLE, ok, addr, expect, expect_addr);
+
+    // Started from a sentinel, so a conditional move that writes on reject shows up
+    addr = 0xA5A5A5A5;
+    ok = parse_ipv4_branchless(p, n, &addr);
+    check_result(&failed, CHECK_BRANCHLESS, ok, addr, expect, expect_addr);
+    if (!ok && addr != 0xA5A5A5A5) {
+        failed |= 1u << CHECK_BRANCHLESS;  // *out changed although the input was rejected
+    }
+
+#ifdef IPV4_HAVE_SSSE3
+    if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt")) {
+        addr = 0;
+        ok = parse_ipv4_ssse3(p, n, &addr);
+        check_result(&failed, CHECK_SSSE3, ok, addr, expect, expect_addr);
+    }
+#endif
+#ifdef IPV4_HAVE_NEON
+    addr = 0;
+    ok = parse_ipv4_neon(p, n, &addr);
+    check_result(&failed, CHECK_NEON, ok, addr, expect, expect_addr);
+#endif
+
+    addr = 0;
+    ok = parse_ipv4(p, n, &addr);
+    check_result(&failed, CHECK_DISPATCH, ok, addr, expect, expect_addr);
+
+    // validate_ip() stops at the first '\0', so only whole C strings are comparable
+    if (!has_nul && n < sizeof(copy)) {
+        check_result(&failed, CHECK_VALIDATE_IP, validate_ip(copy), expect_addr, expect, expect_addr);
+    }
+    check_result(&failed, CHECK_VALIDATE_IP_N, validate_ip_n(p, n), expect_addr, expect, expect_addr);
+
+    uint8_t bitmap = 0xFF;
+    addr = 0xFFFFFFFF;
+    size_t count = validate_ip_batch(&p, &n, 1, &bitmap, &addr);
+    if (count != (size_t)expect || bitmap != (uint8_t)expect || addr != expect_addr) {
+        failed |= 1u << CHECK_BATCH;
+    }
+
+    // Classification must not change the verdict, and rejects carry no flags
+    unsigned flags = 0xFF;
+    addr = 0;
+    ok = parse_ipv4_classify(p, n, &addr, &flags);
+    check_result(&failed, CHECK_CLASSIFY, ok, addr, expect, expect_addr);
+    uint8_t cls = 0xFF;
+    bitmap = 0xFF;
+    addr = 0xFFFFFFFF;
+    count = validate_ip_batch_classify(&p, &n, 1, &bitmap, &addr, &cls);
+    unsigned expect_flags = expect ? reference_classify(expect_addr) : 0;
+    if (flags != expect_flags || cls != expect_flags || count != (size_t)expect ||
+        bitmap != (uint8_t)expect || addr != expect_addr) {
+        failed |= 1u << CHECK_CLASSIFY;
+    }
+
+    // Twice, so both the miss and the hit path are exercised
+    for (int pass = 0; pass < 2; pass++) {
+        addr = 0;
+        ok = ipv4_cache_parse(ctx->cache, p, n, &addr);
+        check_result(&failed, CHECK_CACHE, ok, addr, expect, expect_addr);
+    }
+
+    size_t pos = 0;
+    addr = 0;
+    enum ipv4_error err = parse_ipv4_ex(p, n, &addr, &pos);
+    check_result(&failed, CHECK_EX, err == IPV4_OK, addr, expect, expect_addr);
+    if (err != IPV4_OK && pos > n) {
+        failed |= 1u << CHECK_EX;  // Error position outside the candidate
+    }
+
+    // parse_ip() may accept IPv6, but must agree on everything that is not
+    struct ip_addr ipa;
+    int family = parse_ip(p, n, &ipa);
+    if (family != 6) {
+        check_result(&failed, CHECK_PARSE_IP, family == 4, family == 4 ? ipa.v4 : 0,
+                     expect, expect_addr);
+    }
+
+    // The looser dialects must accept everything the strict one does, with the same value
+    if (expect) {
+        uint32_t aton = 0, padded = 0;
+        if (!parse_ipv4_aton(p, n, &aton) || aton != expect_addr ||
+            !parse_ipv4_zero_padded(p, n, &padded) || padded != expect_addr) {
+            failed |= 1u << CHECK_DIALECTS;
+        }
+    }
+
+    // The arena-backed collector must find exactly what ipv4_find_next() finds
+    struct ipv4_match* all = NULL;
+    size_t found = 0;
+    ipv4_arena_reset(ctx->arena);
+    if (!ipv4_extract_all(ctx->arena, p, n, &all, &found)) {
+        failed |= 1u << CHECK_EXTRACT;
+    } else {
+        struct ipv4_match m;
+        size_t next = 0, k = 0;
+        while (ipv4_find_next(p, n, &next, &m)) {
+            if (k >= found || all[k].offset != m.offset || all[k].length != m.length ||
+                all[k].addr != m.addr || !validate_ip_n(p + m.offset, m.length)) {
+                failed |= 1u << CHECK_EXTRACT;
+                break;
+            }
+            k++;
+        }
+        if (k != found) {
+            failed |= 1u << CHECK_EXTRACT;
+        }
+    }
+
+    if (!has_nul && n < sizeof(copy)) {
+        size_t aton_len;
+        uint32_t aton_addr = 0;
+        int aton_expect = reference_aton(copy, &aton_len, &aton_addr);
+        if (aton_expect >= 0) {
+            addr = 0;
+            ok = parse_ipv4_aton(p, aton_len, &addr);
+            check_result(&failed, CHECK_ATON, ok, addr, aton_expect, aton_addr);
+        }
+
+        struct in_addr in;
+        int pton = inet_pton(AF_INET, copy, &in) == 1;
+        check_result(&failed, CHECK_PTON, pton, pton ? ntohl(in.s_addr) : 0,
+                     expect, expect_addr);
+
+        // parse_ipv6() has no reference of its own; the C library's is the closest
+        uint8_t v6[16], pton_v6[16];
+        int ok6 = parse_ipv6(p, n, v6);
+        int pton6 = inet_pton(AF_INET6, copy, pton_v6) == 1;
+        if (ok6 != pton6 || (ok6 && memcmp(v6, pton_v6, sizeof(v6)) != 0)) {
+            failed |= 1u << CHECK_PTON6;
+        }
+    }
+
+    return failed;
+}
+
+/*
+ * Prints a candidate with non-printable bytes escaped, so reports stay one line
+ */
+static void check_print(FILE* f, const char* p, size_t n) {
+    fputc('"', f);
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)p[i];
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+            fputc(c, f);
+        } else {
+            fprintf(f, "\\x%02x", c);
+        }
+    }
+    fputc('"', f);
+}
+
+#endif /* VALIDATE_IP_FUZZ_CHECK_H */
@@ -0,0 +1,412 @@
+/*
+ * Differential runner for the IPv4 parsers
+ *
+ * Enumerates every string of up to --max-len characters over a small alphabet,
+ * then a set of random candidates (which reach the lengths the exhaustive part
+ * cannot): mutations of valid IPv4 addresses, and a quarter each of inet_aton()
+ * forms and of IPv6 forms for the inet_aton() and inet_pton(AF_INET6)
+ * comparisons. Each one is run through check_candidate() from the very end of
+ * a page followed by an inaccessible one, so a parser that reads even one byte
+ * past the slice crashes the run instead of passing unnoticed.
+ * The work is split across threads in fixed-size chunks handed out from a
+ * shared counter, so faster threads simply take more chunks.
+ *
+ * Prints the number of disagreements per variant with a few examples each.
+ * Differences from inet_pton() are reported but do not fail the run.
+ *
+ * Build and run with: make differential
+ */
+#include "check.h"
+
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+// Default alphabet: every character class the parsers treat differently
+#define DIFF_DEFAULT_ALPHABET ".0123456789a"
+
+// Default longest exhaustively enumerated string
+#define DIFF_DEFAULT_MAX_LEN 7
+
+// Default number of random mutated candidates after the exhaustive part
+#define DIFF_DEFAULT_RANDOM 10000000ULL
+
+// Candidates claimed by a thread at a time
+#define DIFF_CHUNK 65536
+
+// Examples printed per variant
+#define DIFF_EXAMPLES 5
+
+// Exhaustive strings can be at most this long (the alphabet count overflows soon after)
+#define DIFF_MAX_LEN 12
+
+static const char* diff_alphabet = DIFF_DEFAULT_ALPHABET;
+static size_t diff_symbols;
+static size_t diff_max_len = DIFF_DEFAULT_MAX_LEN;
+static uint64_t diff_random = DIFF_DEFAULT_RANDOM;
+
+// first[L] = index of the first string of length L in the exhaustive space
+static uint64_t diff_first[DIFF_MAX_LEN + 2];
+
+static _Atomic uint64_t diff_next;                  // Next unclaimed candidate index
+static _Atomic uint64_t diff_failures[CHECK_COUNT]; // Disagreements per variant
+static pthread_mutex_t diff_print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Counts a disagreement and prints it if it is one of the first few for that variant
+static void diff_report(unsigned failed, const char* p, size_t n) {
+    for (int e = 0; e < CHECK_COUNT; e++) {
+        if (!(failed & (1u << e))) {
+            continue;
+        }
+        if (atomic_fetch_add_explicit(&diff_failures[e], 1, memory_order_relaxed) < DIFF_EXAMPLES) {
+            pthread_mutex_lock(&diff_print_lock);
+            fprintf(stderr, "%s disagrees on ", check_engine_names[e]);
+            check_print(stderr, p, n);
+            fputc('\n', stderr);
+            pthread_mutex_unlock(&diff_print_lock);
+        }
+    }
+}
+
+// Writes exhaustive candidate number index into buf and returns its length
+static size_t diff_exhaustive(uint64_t index, char* buf) {
+    size_t len = 0;
+    while (index >= diff_first[len + 1]) {
+        len++;
+    }
+    uint64_t rest = index - diff_first[len];
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = diff_alphabet[rest % diff_symbols];
+        rest /= diff_symbols;
+    }
+    return len;
+}
+
+/*
+ * Writes random candidate number index into buf and returns its length: a
+ * valid address with up to three edits that target the rules (octet range,
+ * leading zeros, dot placement, stray bytes including '\0')
+ */
+static size_t diff_mutated(uint64_t index, char* buf) {
+    // splitmix64 of the index, so each candidate is reproducible on its own
+    uint64_t state = index * 0x9E3779B97F4A7C15ULL;
+#define DIFF_NEXT() \
+    (state += 0x9E3779B97F4A7C15ULL, \
+     ((state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL) ^ (state >> 27))
+
+    uint64_t r = DIFF_NEXT();
+    int len = snprintf(buf, 40, "%u.%u.%u.%u", (unsigned)(r & 0xFF), (unsigned)((r >> 8) & 0xFF),
+                       (unsigned)((r >> 16) & 0xFF), (unsigned)((r >> 24) & 0xFF));
+    unsigned edits = (unsigned)((r >> 32) % 4);
+    static const char stray[] = "0123456789..:x/ \xff";
+    for (unsigned k = 0; k < edits; k++) {
+        r = DIFF_NEXT();
+        int at = (int)((r >> 8) % (uint64_t)(len + 1));
+        switch (r & 7) {
+        case 0:  // Deletion
+            if (len > 0) {
+                if (at == len) {
+                    at--;
+                }
+                memmove(buf + at, buf + at + 1, (size_t)(len - at));
+                len--;
+            }
+            break;
+        case 1:  // Leading zero
+            if (len < 32) {
+                memmove(buf + at + 1, buf + at, (size_t)(len - at + 1));
+                buf[at] = '0';
+                len++;
+            }
+            break;
+        case 2:  // Embedded '\0' or high byte
+            if (at < len) {
+                buf[at] = (r & 8) ? '\0' : (char)0xFF;
+            }
+            break;
+        case 3:  // Octet bumped out of range
+            len = snprintf(buf, 40, "%u.%u.%u.%u", (unsigned)((r >> 16) % 1000),
+                           (unsigned)((r >> 26) % 300), (unsigned)((r >> 36) % 300),
+                           (unsigned)((r >> 46) % 300));
+            break;
+        default:  // Insertion or replacement from the stray set
+            if (len < 32) {
+                char c = stray[(r >> 20) % (sizeof(stray) - 1)];
+                if (r & 8) {
+                    memmove(buf + at + 1, buf + at, (size_t)(len - at + 1));
+                    len++;
+                }
+                buf[at] = c;
+            }
+            break;
+        }
+    }
+#undef DIFF_NEXT
+    return (size_t)len;
+}
+
+/*
+ * Writes an inet_aton() candidate into buf and returns its length: 1-4 parts
+ * in decimal, octal or hex (sometimes with extra leading zeros, a bare "0x" or
+ * a value just out of range), sometimes followed by whitespace and text
+ */
+static size_t diff_aton(uint64_t index, char* buf) {
+    uint64_t state = index * 0x94D049BB133111EBULL;
+#define DIFF_NEXT() \
+    (state += 0x9E3779B97F4A7C15ULL, \
+     ((state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL) ^ (state >> 27))
+
+    uint64_t r = DIFF_NEXT();
+    unsigned parts = 1 + (unsigned)(r % 4);
+    int len = 0;
+    for (unsigned k = 0; k < parts; k++) {
+        r = DIFF_NEXT();
+        // Earlier parts hold a byte, the last one whatever bytes are left; one step past sometimes
+        uint64_t limit = k + 1 < parts ? 0xFF : 0xFFFFFFFFULL >> (8 * k);
+        uint64_t value = (r >> 16) % (limit + 1);
+        if ((r & 15) == 0) {
+            value = limit + 1 + ((r >> 48) & 0xFF);
+        }
+        if (k != 0) {
+            buf[len++] = '.';
+        }
+        switch ((r >> 4) & 7) {
+        case 0:
+        case 1:
+            len += snprintf(buf + len, 16, "%llu", (unsigned long long)value);
+            break;
+        case 2:
+        case 3:
+            len += snprintf(buf + len, 16, "0%llo", (unsigned long long)value);
+            break;
+        case 4:
+            len += snprintf(buf + len, 16, "0x%llx", (unsigned long long)value);
+            break;
+        case 5:
+            len += snprintf(buf + len, 16, "0X%llX", (unsigned long long)value);
+            break;
+        case 6:
+            len += snprintf(buf + len, 16, "00%llu", (unsigned long long)value);
+            break;
+        default:  // A bare prefix, which only inet_aton() accepts
+            buf[len++] = '0';
+            buf[len++] = (r & 0x100) ? 'x' : 'X';
+            break;
+        }
+    }
+    if (((r >> 12) & 7) == 0) {
+        len += snprintf(buf + len, 8, "%s", (r & 0x8000) ? " junk" : "\t");
+    }
+#undef DIFF_NEXT
+    return (size_t)len;
+}
+
+/*
+ * Writes an IPv6 candidate into buf and returns its length: eight groups of
+ * 1-4 hex digits in mixed case, optionally with a run of them folded into
+ * "::" or the last two written as a dotted quad, then up to two stray edits
+ */
+static size_t diff_ipv6(uint64_t index, char* buf) {
+    uint64_t state = index * 0xD1B54A32D192ED03ULL;
+#define DIFF_NEXT() \
+    (state += 0x9E3779B97F4A7C15ULL, \
+     ((state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL) ^ (state >> 27))
+
+    static const char hex[] = "0123456789abcdef0123456789ABCDEF";
+    uint64_t r = DIFF_NEXT();
+    int quad = (r & 3) == 0;                             // Last two groups as a dotted quad
+    unsigned groups = quad ? 6 : 8;
+    unsigned gap = (unsigned)((r >> 2) % (groups + 2));  // First group of the "::" run, none if >= groups
+    unsigned gap_len = 1 + (unsigned)((r >> 8) % 4);
+    int len = 0;
+    for (unsigned g = 0; g < groups; g++) {
+        if (g == gap) {
+            buf[len++] = ':';
+            buf[len++] = ':';
+            g += gap_len - 1;  // The folded groups; whatever follows needs no separator
+            continue;
+        }
+        if (len != 0 && buf[len - 1] != ':') {
+            buf[len++] = ':';
+        }
+        r = DIFF_NEXT();
+        unsigned digits = 1 + (unsigned)(r % 4);
+        for (unsigned d = 0; d < digits; d++) {
+            buf[len++] = hex[(r >> (8 + 5 * d)) & 31];
+        }
+    }
+    if (quad) {
+        r = DIFF_NEXT();
+        if (len != 0 && buf[len - 1] != ':') {
+            buf[len++] = ':';
+        }
+        len += snprintf(buf + len, 20, "%u.%u.%u.%u", (unsigned)(r & 0xFF), (unsigned)((r >> 8) & 0xFF),
+                        (unsigned)((r >> 16) & 0xFF), (unsigned)((r >> 24) & 0xFF));
+    }
+
+    static const char stray[] = "0aF::.%g ";
+    unsigned edits = (unsigned)((DIFF_NEXT() >> 40) % 3);
+    for (unsigned k = 0; k < edits; k++) {
+        r = DIFF_NEXT();
+        int at = (int)((r >> 8) % (uint64_t)len);
+        if (r & 1) {
+            memmove(buf + at, buf + at + 1, (size_t)(len - at));  // Deletion
+            len--;
+        } else if (len < 56) {
+            memmove(buf + at + 1, buf + at, (size_t)(len - at + 1));  // Insertion
+            buf[at] = stray[(r >> 20) % (sizeof(stray) - 1)];
+            len++;
+        }
+    }
+#undef DIFF_NEXT
+    return (size_t)len;
+}
+
+// Writes random candidate number index into buf and returns its length
+static size_t diff_random_candidate(uint64_t index, char* buf) {
+    switch (index % 4) {
+    case 2:
+        return diff_aton(index, buf);
+    case 3:
+        return diff_ipv6(index, buf);
+    default:
+        return diff_mutated(index, buf);
+    }
+}
+
+static void* diff_worker(void* arg) {
+    (void)arg;
+    struct ipv4_cache* cache = malloc(sizeof(*cache));
+    if (cache == NULL) {
+        fprintf(stderr, "validate-ip-diff: out of memory\n");
+        exit(1);
+    }
+    ipv4_cache_init(cache);
+    struct ipv4_arena arena;
+    ipv4_arena_init(&arena, 0);
+    struct check_ctx ctx = {cache, &arena};
+
+    // Candidates are built in buf, then checked from the end of guard's first page
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* guard = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (guard == MAP_FAILED || mprotect(guard + page, page, PROT_NONE) != 0) {
+        fprintf(stderr, "validate-ip-diff: cannot map the guard page\n");
+        exit(1);
+    }
+
+    uint64_t exhaustive = diff_first[diff_max_len + 1];
+    uint64_t total = exhaustive + diff_random;
+    char buf[64];
+    for (;;) {
+        uint64_t begin = atomic_fetch_add_explicit(&diff_next, DIFF_CHUNK, memory_order_relaxed);
+        if (begin >= total) {
+            break;
+        }
+        uint64_t end = begin + DIFF_CHUNK < total ? begin + DIFF_CHUNK : total;
+        for (uint64_t i = begin; i < end; i++) {
+            size_t n = i < exhaustive ? diff_exhaustive(i, buf)
+                                      : diff_random_candidate(i - exhaustive, buf);
+            char* p = memcpy(guard + page - n, buf, n);
+            unsigned failed = check_candidate(&ctx, p, n);
+            if (failed != 0) {
+                diff_report(failed, p, n);
+            }
+        }
+    }
+    munmap(guard, 2 * page);
+    ipv4_arena_release(&arena);
+    free(cache);
+    return NULL;
+}
+
+static void print_usage(FILE* f) {
+    fprintf(f,
+            "Usage: validate-ip-diff [--max-len N] [--alphabet CHARS] [--random N] [--threads N]\n"
+            "\n"
+            "  --max-len N       enumerate every string up to N characters (default %d, max %d)\n"
+            "  --alphabet CHARS  characters to enumerate over (default \"%s\")\n"
+            "  --random N        random candidates to try afterwards (default %llu)\n"
+            "  --threads N       worker threads (default: all cores)\n",
+            DIFF_DEFAULT_MAX_LEN, DIFF_MAX_LEN, DIFF_DEFAULT_ALPHABET,
+            (unsigned long long)DIFF_DEFAULT_RANDOM);
+}
+
+int main(int argc, char* argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        char* end = NULL;
+        if (strcmp(arg, "--alphabet") == 0 && value != NULL && value[0] != '\0') {
+            diff_alphabet = value;
+        } else if (strcmp(arg, "--max-len") == 0 && value != NULL) {
+            diff_max_len = strtoul(value, &end, 10);
+            if (*end != '\0' || diff_max_len > DIFF_MAX_LEN) {
+                print_usage(stderr);
+                return 2;
+            }
+        } else if (strcmp(arg, "--random") == 0 && value != NULL) {
+            diff_random = strtoull(value, &end, 10);
+            if (*end != '\0') {
+                print_usage(stderr);
+                return 2;
+            }
+        } else if (strcmp(arg, "--threads") == 0 && value != NULL) {
+            threads = strtol(value, &end, 10);
+            if (*end != '\0' || threads < 1 || threads > 1024) {
+                print_usage(stderr);
+                return 2;
+            }
+        } else {
+            print_usage(strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? stdout : stderr);
+            return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 2;
+        }
+        i++;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    diff_symbols = strlen(diff_alphabet);
+    diff_first[0] = 0;
+    uint64_t count = 1;  // Strings of the current length
+    for (size_t len = 0; len <= diff_max_len; len++) {
+        if (count > (UINT64_MAX >> 8) - diff_first[len]) {
+            fprintf(stderr, "validate-ip-diff: alphabet too large for --max-len %zu\n", diff_max_len);
+            return 2;
+        }
+        diff_first[len + 1] = diff_first[len] + count;
+        count *= diff_symbols;
+    }
+
+    pthread_t* ids = malloc(sizeof(*ids) * (size_t)threads);
+    if (ids == NULL) {
+        fprintf(stderr, "validate-ip-diff: out of memory\n");
+        return 1;
+    }
+    long started = 0;
+    while (started < threads && pthread_create(&ids[started], NULL, diff_worker, NULL) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        diff_worker(NULL);
+    }
+    for (long t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    free(ids);
+
+    uint64_t total = diff_first[diff_max_len + 1] + diff_random;
+    printf("candidates %llu (exhaustive %llu, random %llu), threads %ld\n",
+           (unsigned long long)total, (unsigned long long)diff_first[diff_max_len + 1],
+           (unsigned long long)diff_random, started > 0 ? started : 1);
+    int status = 0;
+    for (int e = 0; e < CHECK_COUNT; e++) {
+        uint64_t n = atomic_load(&diff_failures[e]);
+        printf("%-14s %llu%s\n", check_engine_names[e], (unsigned long long)n,
+               (CHECK_PTON_MASK & (1u << e)) && n != 0 ? " (informational)" : "");
+        if (n != 0 && (CHECK_ENGINE_MASK & (1u << e))) {
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,433 @@
+/*
+ * Exhaustive verification over the whole IPv4 address space
+ *
+ * Formats every address in a range (by default all 2^32 of them) with
+ * format_ipv4(), adds a few near-miss mutations of each, and runs them all
+ * through every parser variant.
+ * Each formatted address must be accepted by all of them and decode back to
+ * the address it was formatted from. Mutations that are invalid by
+ * construction (a leading zero, a bad separator, an octet above 255) must be
+ * rejected; for the two whose validity depends on the value (a digit appended,
+ * the last character dropped) parse_ipv4_scalar() is the oracle, as it is
+ * checked against the original validate_ip() by validate-ip-diff.
+ *
+ * The range is cut into chunks that each thread owns as a [begin, end) pair
+ * packed into one 64-bit word. A thread takes chunks from the front of its own
+ * range, and when it runs dry steals the back half of another thread's range
+ * with a single compare-and-swap, so the sweep stays balanced whatever the
+ * speed of each core.
+ *
+ * Build and run with: make exhaustive
+ */
+#include "check.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+// Addresses per chunk, the unit of work that threads take and steal
+#define EXH_CHUNK 4096
+
+// Candidates made from each address: the address itself and its mutations
+#define EXH_PER_ADDR 6
+
+/*
+ * One candidate of a chunk: offset and length into the chunk's text, and the
+ * verdict every variant must give
+ */
+struct exh_candidate {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t addr;     // Expected packed value when valid
+    uint32_t valid;    // Expected verdict
+};
+
+/*
+ * Per-thread state. The range word is the only field other threads touch.
+ */
+struct exh_worker {
+    _Alignas(64) _Atomic uint64_t range;  // begin chunk in the low half, end chunk in the high half
+    pthread_t id;
+    struct ipv4_cache* cache;
+    char* text;                           // Null-terminated candidates of one chunk, back to back
+    struct exh_candidate* cand;
+    const char** ptrs;                    // Batch API inputs
+    size_t* lens;
+    uint8_t* bitmap;
+    uint32_t* addrs;
+    uint8_t* classes;
+    uint64_t candidates;                  // Candidates checked by this thread
+    uint64_t failures[CHECK_COUNT];       // Disagreements by this thread, per variant
+};
+
+static struct exh_worker* exh_workers;
+static long exh_threads;
+static uint64_t exh_first;      // First address of the sweep
+static uint64_t exh_chunks;     // Number of chunks in the sweep
+static uint64_t exh_last;       // Last address of the sweep (inclusive)
+static pthread_mutex_t exh_print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define EXH_PACK(begin, end) ((uint64_t)(begin) | ((uint64_t)(end) << 32))
+#define EXH_BEGIN(range) ((uint32_t)(range))
+#define EXH_END(range) ((uint32_t)((range) >> 32))
+
+// Takes the next chunk from the front of the thread's own range
+static int exh_take(struct exh_worker* w, uint32_t* chunk) {
+    uint64_t range = atomic_load_explicit(&w->range, memory_order_relaxed);
+    while (EXH_BEGIN(range) < EXH_END(range)) {
+        uint64_t next = EXH_PACK(EXH_BEGIN(range) + 1, EXH_END(range));
+        if (atomic_compare_exchange_weak_explicit(&w->range, &range, next, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            *chunk = EXH_BEGIN(range);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Steals the back half of the fullest other range into the thief's own,
+ * currently empty, range. Returns 0 once nobody has two chunks left, at which
+ * point every remaining chunk is already owned by a thread that will do it.
+ */
+static int exh_steal(struct exh_worker* self) {
+    for (;;) {
+        struct exh_worker* victim = NULL;
+        uint64_t seen = 0;
+        uint32_t most = 1;
+        for (long t = 0; t < exh_threads; t++) {
+            uint64_t range = atomic_load_explicit(&exh_workers[t].range, memory_order_relaxed);
+            uint32_t left = EXH_END(range) - EXH_BEGIN(range);
+            if (&exh_workers[t] != self && EXH_BEGIN(range) < EXH_END(range) && left > most) {
+                victim = &exh_workers[t];
+                seen = range;
+                most = left;
+            }
+        }
+        if (victim == NULL) {
+            return 0;
+        }
+        uint32_t mid = EXH_BEGIN(seen) + (EXH_END(seen) - EXH_BEGIN(seen)) / 2;
+        if (atomic_compare_exchange_strong_explicit(&victim->range, &seen,
+                                                    EXH_PACK(EXH_BEGIN(seen), mid),
+                                                    memory_order_relaxed, memory_order_relaxed)) {
+            // Only this thread writes a range into its own slot while it is empty
+            atomic_store_explicit(&self->range, EXH_PACK(mid, EXH_END(seen)), memory_order_relaxed);
+            return 1;
+        }
+    }
+}
+
+// Appends one candidate to the chunk being built
+static void exh_add(struct exh_worker* w, size_t* count, uint32_t* used, const char* s,
+                    uint32_t len, int valid, uint32_t addr) {
+    struct exh_candidate* c = &w->cand[(*count)++];
+    memcpy(w->text + *used, s, len);
+    w->text[*used + len] = '\0';
+    c->offset = *used;
+    c->length = len;
+    c->valid = (uint32_t)valid;
+    c->addr = valid ? addr : 0;
+    *used += len + 1;
+}
+
+// Builds the candidates for one chunk and returns how many there are
+static size_t exh_build(struct exh_worker* w, uint64_t first, uint64_t last) {
+    static const char separators[] = ",:/ a";
+    size_t count = 0;
+    uint32_t used = 0;
+    char buf[24], mut[24];
+    for (uint64_t a = first; a <= last; a++) {
+        uint32_t addr = (uint32_t)a;
+        uint32_t len = (uint32_t)format_ipv4(addr, buf);
+        exh_add(w, &count, &used, buf, len, 1, addr);
+
+        // Leading zero in front of octet addr % 4: never valid
+        unsigned target = addr % 4, dots = 0;
+        uint32_t at = 0;
+        while (dots < target) {
+            dots += buf[at++] == '.';
+        }
+        memcpy(mut, buf, at);
+        mut[at] = '0';
+        memcpy(mut + at + 1, buf + at, len - at);
+        exh_add(w, &count, &used, mut, len + 1, 0, 0);
+
+        // One dot changed into another separator: never valid
+        memcpy(mut, buf, len);
+        for (at = 0; mut[at] != '.'; at++) {
+        }
+        mut[at] = separators[addr % (sizeof(separators) - 1)];
+        exh_add(w, &count, &used, mut, len, 0, 0);
+
+        // First octet pushed past 255: never valid
+        unsigned head = 256 + (addr >> 8) % 744;
+        uint32_t rest = 0;
+        while (buf[rest] != '.') {
+            rest++;
+        }
+        uint32_t mlen = (uint32_t)snprintf(mut, sizeof(mut), "%u%s", head, buf + rest);
+        exh_add(w, &count, &used, mut, mlen, 0, 0);
+
+        // A digit appended, and the last character dropped: depends on the value
+        memcpy(mut, buf, len);
+        mut[len] = (char)('0' + addr % 10);
+        uint32_t v = 0;
+        int ok = parse_ipv4_scalar(mut, len + 1, &v);
+        exh_add(w, &count, &used, mut, len + 1, ok, v);
+        ok = parse_ipv4_scalar(buf, len - 1, &v);
+        exh_add(w, &count, &used, buf, len - 1, ok, v);
+    }
+    return count;
+}
+
+// Counts a disagreement and prints the first few
+static void exh_fail(struct exh_worker* w, enum check_engine engine, const struct exh_candidate* c) {
+    if (w->failures[engine]++ < 3) {
+        pthread_mutex_lock(&exh_print_lock);
+        fprintf(stderr, "%s disagrees on ", check_engine_names[engine]);
+        check_print(stderr, w->text + c->offset, c->length);
+        fprintf(stderr, " (expected %s)\n", c->valid ? "valid" : "invalid");
+        pthread_mutex_unlock(&exh_print_lock);
+    }
+}
+
+// parse_ip() reduced to the parse_ipv4() contract
+static int exh_parse_ip(const char* p, size_t n, uint32_t* addr) {
+    struct ip_addr ipa;
+    if (parse_ip(p, n, &ipa) != 4) {
+        return 0;
+    }
+    *addr = ipa.v4;
+    return 1;
+}
+
+// Runs every variant over the chunk's candidates, one variant at a time
+static void exh_check(struct exh_worker* w, size_t count) {
+#define EXH_ENGINE(engine, call)                                          \
+    for (size_t i = 0; i < count; i++) {                                   \
+        const struct exh_candidate* c = &w->cand[i];                       \
+        const char* p = w->text + c->offset;                               \
+        size_t n = c->length;                                              \
+        uint32_t addr = 0;                                                 \
+        (void)n;                                                           \
+        int ok = (call);                                                   \
+        if ((ok != 0) != (int)c->valid || (c->valid && addr != c->addr)) { \
+            exh_fail(w, engine, c);                                        \
+        }                                                                  \
+    }
+
+    EXH_ENGINE(CHECK_SCALAR, parse_ipv4_scalar(p, n, &addr))
+    EXH_ENGINE(CHECK_TABLE, parse_ipv4_table(p, n, &addr))
+    EXH_ENGINE(CHECK_BRANCHLESS, parse_ipv4_branchless(p, n, &addr))
+#ifdef IPV4_HAVE_SSSE3
+    if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt")) {
+        EXH_ENGINE(CHECK_SSSE3, parse_ipv4_ssse3(p, n, &addr))
+    }
+#endif
+#ifdef IPV4_HAVE_NEON
+    EXH_ENGINE(CHECK_NEON, parse_ipv4_neon(p, n, &addr))
+#endif
+    EXH_ENGINE(CHECK_DISPATCH, parse_ipv4(p, n, &addr))
+    EXH_ENGINE(CHECK_VALIDATE_IP, (addr = c->addr, validate_ip(p)))
+    EXH_ENGINE(CHECK_VALIDATE_IP_N, (addr = c->addr, validate_ip_n(p, n)))
+    EXH_ENGINE(CHECK_CACHE, ipv4_cache_parse(w->cache, p, n, &addr))
+    EXH_ENGINE(CHECK_EX, parse_ipv4_ex(p, n, &addr, NULL) == IPV4_OK)
+    EXH_ENGINE(CHECK_PARSE_IP, exh_parse_ip(p, n, &addr))
+#undef EXH_ENGINE
+
+    // The looser dialects only have to agree on what the strict rules accept
+    for (size_t i = 0; i < count; i++) {
+        const struct exh_candidate* c = &w->cand[i];
+        uint32_t aton = 0, padded = 0;
+        if (c->valid && (!parse_ipv4_aton(w->text + c->offset, c->length, &aton) ||
+                         aton != c->addr ||
+                         !parse_ipv4_zero_padded(w->text + c->offset, c->length, &padded) ||
+                         padded != c->addr)) {
+            exh_fail(w, CHECK_DIALECTS, c);
+        }
+    }
+
+    // inet_aton() itself, on the part of each candidate it looks at
+    for (size_t i = 0; i < count; i++) {
+        const struct exh_candidate* c = &w->cand[i];
+        size_t len;
+        uint32_t expect_addr = 0, addr = 0;
+        int expect = reference_aton(w->text + c->offset, &len, &expect_addr);
+        if (expect >= 0) {
+            int ok = parse_ipv4_aton(w->text + c->offset, len, &addr);
+            if (ok != expect || (ok && addr != expect_addr)) {
+                exh_fail(w, CHECK_ATON, c);
+            }
+        }
+    }
+
+    // Range flags of every valid address, and none for a reject
+    for (size_t i = 0; i < count; i++) {
+        const struct exh_candidate* c = &w->cand[i];
+        uint32_t addr = 0;
+        unsigned flags = 0xFF;
+        int ok = parse_ipv4_classify(w->text + c->offset, c->length, &addr, &flags);
+        if ((ok != 0) != (int)c->valid || (c->valid && addr != c->addr) ||
+            flags != (c->valid ? reference_classify(c->addr) : 0)) {
+            exh_fail(w, CHECK_CLASSIFY, c);
+        }
+    }
+
+    // The batch API over the whole chunk at once, with the class column
+    for (size_t i = 0; i < count; i++) {
+        w->ptrs[i] = w->text + w->cand[i].offset;
+        w->lens[i] = w->cand[i].length;
+    }
+    validate_ip_batch_classify(w->ptrs, w->lens, count, w->bitmap, w->addrs, w->classes);
+    for (size_t i = 0; i < count; i++) {
+        const struct exh_candidate* c = &w->cand[i];
+        if (((w->bitmap[i / 8] >> (i % 8)) & 1) != c->valid || w->addrs[i] != c->addr) {
+            exh_fail(w, CHECK_BATCH, c);
+        }
+        if (w->classes[i] != (c->valid ? reference_classify(c->addr) : 0)) {
+            exh_fail(w, CHECK_CLASSIFY, c);
+        }
+    }
+
+    w->candidates += count;
+}
+
+static void* exh_worker_main(void* arg) {
+    struct exh_worker* w = arg;
+    uint32_t chunk;
+    for (;;) {
+        while (exh_take(w, &chunk)) {
+            uint64_t first = exh_first + (uint64_t)chunk * EXH_CHUNK;
+            uint64_t last = first + EXH_CHUNK - 1 < exh_last ? first + EXH_CHUNK - 1 : exh_last;
+            exh_check(w, exh_build(w, first, last));
+        }
+        if (!exh_steal(w)) {
+            return NULL;
+        }
+    }
+}
+
+// Parses a dotted-quad command line argument
+static int exh_parse_addr(const char* s, uint64_t* out) {
+    uint32_t addr;
+    if (!parse_ipv4(s, strlen(s), &addr)) {
+        fprintf(stderr, "validate-ip-exhaustive: '%s' is not a valid address\n", s);
+        return 0;
+    }
+    *out = addr;
+    return 1;
+}
+
+static void print_usage(FILE* f) {
+    fprintf(f,
+            "Usage: validate-ip-exhaustive [--from ADDR] [--to ADDR] [--threads N]\n"
+            "\n"
+            "  --from ADDR   first address of the sweep (default 0.0.0.0)\n"
+            "  --to ADDR     last address of the sweep (default 255.255.255.255)\n"
+            "  --threads N   worker threads (default: all cores)\n");
+}
+
+int main(int argc, char* argv[]) {
+    exh_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    exh_first = 0;
+    exh_last = 0xFFFFFFFFu;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            print_usage(stdout);
+            return 0;
+        } else if (strcmp(arg, "--from") == 0 && value != NULL) {
+            if (!exh_parse_addr(value, &exh_first)) {
+                return 2;
+            }
+        } else if (strcmp(arg, "--to") == 0 && value != NULL) {
+            if (!exh_parse_addr(value, &exh_last)) {
+                return 2;
+            }
+        } else if (strcmp(arg, "--threads") == 0 && value != NULL) {
+            char* end = NULL;
+            exh_threads = strtol(value, &end, 10);
+            if (*end != '\0' || exh_threads < 1 || exh_threads > 1024) {
+                print_usage(stderr);
+                return 2;
+            }
+        } else {
+            print_usage(stderr);
+            return 2;
+        }
+        i++;
+    }
+    if (exh_threads < 1) {
+        exh_threads = 1;
+    }
+    if (exh_last < exh_first) {
+        fprintf(stderr, "validate-ip-exhaustive: --to is before --from\n");
+        return 2;
+    }
+    exh_chunks = (exh_last - exh_first) / EXH_CHUNK + 1;
+
+    // Every thread starts with an equal share of the chunks
+    exh_workers = calloc((size_t)exh_threads, sizeof(*exh_workers));
+    if (exh_workers == NULL) {
+        fprintf(stderr, "validate-ip-exhaustive: out of memory\n");
+        return 1;
+    }
+    size_t per_chunk = (size_t)EXH_CHUNK * EXH_PER_ADDR;
+    for (long t = 0; t < exh_threads; t++) {
+        struct exh_worker* w = &exh_workers[t];
+        uint64_t begin = exh_chunks * (uint64_t)t / (uint64_t)exh_threads;
+        uint64_t end = exh_chunks * (uint64_t)(t + 1) / (uint64_t)exh_threads;
+        atomic_init(&w->range, EXH_PACK(begin, end));
+        w->cache = malloc(sizeof(*w->cache));
+        w->text = malloc(per_chunk * 20);
+        w->cand = malloc(per_chunk * sizeof(*w->cand));
+        w->ptrs = malloc(per_chunk * sizeof(*w->ptrs));
+        w->lens = malloc(per_chunk * sizeof(*w->lens));
+        w->bitmap = malloc((per_chunk + 7) / 8);
+        w->addrs = malloc(per_chunk * sizeof(*w->addrs));
+        w->classes = malloc(per_chunk);
+        if (w->cache == NULL || w->text == NULL || w->cand == NULL || w->ptrs == NULL ||
+            w->lens == NULL || w->bitmap == NULL || w->addrs == NULL || w->classes == NULL) {
+            fprintf(stderr, "validate-ip-exhaustive: out of memory\n");
+            return 1;
+        }
+        ipv4_cache_init(w->cache);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long t = 1; t < exh_threads; t++) {
+        if (pthread_create(&exh_workers[t].id, NULL, exh_worker_main, &exh_workers[t]) != 0) {
+            fprintf(stderr, "validate-ip-exhaustive: cannot start thread\n");
+            return 1;
+        }
+    }
+    exh_worker_main(&exh_workers[0]);
+    for (long t = 1; t < exh_threads; t++) {
+        pthread_join(exh_workers[t].id, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    uint64_t candidates = 0;
+    uint64_t failures[CHECK_COUNT] = {0};
+    for (long t = 0; t < exh_threads; t++) {
+        candidates += exh_workers[t].candidates;
+        for (int e = 0; e < CHECK_COUNT; e++) {
+            failures[e] += exh_workers[t].failures[e];
+        }
+    }
+    printf("addresses %llu, candidates %llu, threads %ld, %.1f s, %.1f M candidates/s\n",
+           (unsigned long long)(exh_last - exh_first + 1), (unsigned long long)candidates,
+           exh_threads, seconds, seconds > 0 ? (double)candidates / seconds / 1e6 : 0.0);
+    int status = 0;
+    for (int e = 0; e < CHECK_COUNT; e++) {
+        if ((CHECK_PTON_MASK & (1u << e)) || e == CHECK_EXTRACT) {
+            continue;  // Not part of this sweep, see validate-ip-diff
+        }
+        printf("%-14s %llu\n", check_engine_names[e], (unsigned long long)failures[e]);
+        status |= failures[e] != 0;
+    }
+    return status;
+}
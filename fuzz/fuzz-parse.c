@@ -0,0 +1,90 @@
+/*
+ * Fuzz target for the IPv4 parsers
+ *
+ * Every input is fed to check_candidate(), which runs all parser variants and
+ * compares them with the original validate_ip(). Any disagreement aborts, so
+ * the fuzzer reports it as a crash together with the input. Differences from
+ * inet_pton() (for either family) are only fatal when built with
+ * -DFUZZ_PTON_FATAL.
+ *
+ * libFuzzer:  make fuzz && ./fuzz/validate-ip-fuzz
+ * AFL++:      build this file together with ../validate-ip.c using
+ *             afl-clang-fast -fsanitize=fuzzer (or -DFUZZ_STANDALONE and
+ *             afl-gcc) and run under afl-fuzz
+ * Standalone: -DFUZZ_STANDALONE adds a main() that runs each file named on the
+ *             command line (or standard input) once, to replay crashes
+ */
+#include "check.h"
+
+#ifdef FUZZ_PTON_FATAL
+#define FUZZ_FATAL_MASK (CHECK_ENGINE_MASK | CHECK_PTON_MASK)
+#else
+#define FUZZ_FATAL_MASK CHECK_ENGINE_MASK
+#endif
+
+static struct ipv4_cache fuzz_cache;
+static struct ipv4_arena fuzz_arena;
+static int fuzz_ready;
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (!fuzz_ready) {
+        ipv4_cache_init(&fuzz_cache);
+        ipv4_arena_init(&fuzz_arena, 0);
+        fuzz_ready = 1;
+    }
+    struct check_ctx ctx = {&fuzz_cache, &fuzz_arena};
+    unsigned failed = check_candidate(&ctx, (const char*)data, size) & FUZZ_FATAL_MASK;
+    if (failed != 0) {
+        fprintf(stderr, "validate-ip-fuzz: disagreement on ");
+        check_print(stderr, (const char*)data, size);
+        for (int e = 0; e < CHECK_COUNT; e++) {
+            if (failed & (1u << e)) {
+                fprintf(stderr, " %s", check_engine_names[e]);
+            }
+        }
+        fputc('\n', stderr);
+        abort();
+    }
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+// Runs one whole stream as one input
+static void fuzz_run_file(FILE* f) {
+    size_t cap = 4096, len = 0;
+    char* buf = malloc(cap);
+    size_t got;
+    while (buf != NULL && (got = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += got;
+        if (len == cap) {
+            char* grown = realloc(buf, cap * 2);
+            if (grown == NULL) {
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    if (buf != NULL) {
+        LLVMFuzzerTestOneInput((const uint8_t*)buf, len);
+        free(buf);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fuzz_run_file(stdin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE* f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            fprintf(stderr, "validate-ip-fuzz: cannot open '%s'\n", argv[i]);
+            return 1;
+        }
+        fuzz_run_file(f);
+        fclose(f);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Check for the C++ header validate-ip.hpp
+ *
+ * The static_asserts below are the compile-time half: they only build if
+ * ipv4::parse(), ipv4::validate(), operator""_ipv4 and IPV4_LITERAL() give the
+ * expected answers during constant evaluation. The run-time half compares
+ * ipv4::validate() with validate_ip() on random strings written into a
+ * 16-byte array (so the array is usually larger than its string, and some
+ * strings have an embedded '\0'), and ipv4::parse() with parse_ipv4_scalar()
+ * on the same bytes as a slice, verdicts and packed values both.
+ *
+ * Build and run under every supported standard with: make literals
+ */
+#include "../validate-ip.hpp"
+#include "../validate-ip.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace ipv4::literals;
+
+// Random strings per run
+#define LITERALS_RANDOM 2000000
+
+static_assert(ipv4::validate("10.0.0.1"), "plain address");
+static_assert(ipv4::validate("255.255.255.255"), "largest octets");
+static_assert(ipv4::validate("0.0.0.0"), "zero octets");
+static_assert(!ipv4::validate("256.0.0.1"), "octet above 255");
+static_assert(!ipv4::validate("10.0.0.01"), "leading zero");
+static_assert(!ipv4::validate("10.0.0"), "three octets");
+static_assert(!ipv4::validate("10.0.0.1."), "trailing dot");
+static_assert(!ipv4::validate(""), "empty");
+static_assert(ipv4::validate("10.0.0.1\0junk"), "ignores what follows the null");
+static_assert(!ipv4::validate("10.0.\0.1"), "stops at the embedded null");
+
+constexpr char padded[16] = "10.0.0.1";
+constexpr char unterminated[8] = {'1', '.', '2', '.', '3', '.', '4', '5'};
+static_assert(ipv4::validate(padded), "array larger than its string");
+// Reading past the array would not be a constant expression, so this compiling shows it stops
+static_assert(ipv4::validate(unterminated), "array without a null, read up to its end");
+
+static_assert("10.0.0.1"_ipv4 == 0x0A000001u, "literal operator value");
+static_assert("255.255.255.255"_ipv4 == 0xFFFFFFFFu, "literal operator largest value");
+static_assert(IPV4_LITERAL("192.168.1.254") == 0xC0A801FEu, "IPV4_LITERAL value");
+
+constexpr bool parse_value(const char* ip, std::size_t len, std::uint32_t expect) {
+    std::uint32_t addr = 0;
+    return ipv4::parse(ip, len, &addr) && addr == expect;
+}
+static_assert(parse_value("1.2.3.4xyz", 7, 0x01020304u), "slice of a longer buffer");
+static_assert(!ipv4::parse("1.2.3.4", 6, nullptr), "slice cut short");
+
+int main() {
+    static const char alphabet[] = "0123456789...........12a";
+    unsigned long long state = 0x9E3779B97F4A7C15ULL, failures = 0;
+    for (long i = 0; i < LITERALS_RANDOM; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned long long r = state;
+        char buf[16];
+        std::memset(buf, 0, sizeof(buf));
+        std::size_t len = 5 + (std::size_t)(r >> 60);  // 5-20, so some fill the whole array
+        unsigned long long bits = r;
+        for (std::size_t j = 0; j < len && j < sizeof(buf); j++) {
+            if (j % 8 == 0) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                bits = state >> 8;
+            }
+            buf[j] = alphabet[(bits & 0xFF) % (sizeof(alphabet) - 1)];
+            bits >>= 8;
+        }
+        if ((r & 0xF) == 0) {
+            buf[(r >> 8) % sizeof(buf)] = '\0';  // Embedded null
+        }
+        buf[sizeof(buf) - 1] = (r & 0x10) ? '\0' : buf[sizeof(buf) - 1];
+
+        // validate_ip() needs a terminator; the header must not, so compare on a terminated copy
+        char copy[sizeof(buf) + 1];
+        std::memcpy(copy, buf, sizeof(buf));
+        copy[sizeof(buf)] = '\0';
+        bool want = validate_ip(copy) != 0;
+        if (ipv4::validate(buf) != want) {
+            if (failures++ < 5) {
+                std::fprintf(stderr, "validate disagrees on \"%.16s\"\n", copy);
+            }
+        }
+
+        std::uint32_t a = 0, b = 0;
+        std::size_t n = (std::size_t)(r >> 20) % (sizeof(buf) + 1);
+        bool ok = ipv4::parse(buf, n, &a);
+        if (ok != (parse_ipv4_scalar(buf, n, &b) != 0) || (ok && a != b)) {
+            if (failures++ < 5) {
+                std::fprintf(stderr, "parse disagrees on %zu bytes of \"%.16s\"\n", n, copy);
+            }
+        }
+    }
+    std::printf("C++ %ld, random %d, failures %llu\n", (long)__cplusplus, LITERALS_RANDOM, failures);
+    return failures != 0;
+}
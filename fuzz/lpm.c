@@ -0,0 +1,430 @@
+/*
+ * Reference check for CIDR blocks and the longest-prefix-match table
+ *
+ * Each round draws a random prefix set: mostly random lengths, plus clusters
+ * of long prefixes inside a few /24s (so extension groups are shared, and
+ * shorter prefixes land on /24s that are already extended), /0 and /32
+ * blocks, duplicates of earlier prefixes with new values, and hand-filled
+ * blocks whose network still has host bits set. Every prefix goes through
+ * parse_ipv4_cidr() from text first. The set is loaded twice, once with
+ * ipv4_lpm_build() and once with ipv4_lpm_add() in input order, and lookups
+ * of random and boundary addresses on both tables (one at a time and through
+ * ipv4_lpm_lookup_batch()) are compared with a linear longest-match scan over
+ * the prefix list, where the last of equal prefixes wins.
+ *
+ * The same addresses also go through ipv4_cidr_match_batch() for a few blocks
+ * of the set, at every length up to a few bitmap bytes and at the full count,
+ * so both the SIMD engine the CPU selects and the scalar tail are compared with
+ * ipv4_cidr_contains(), including the cleared bits of the last bitmap byte.
+ *
+ * Build and run with: make lpm
+ */
+#include "../validate-ip.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Defaults for the command line options
+#define LPM_DEFAULT_ROUNDS 10
+#define LPM_DEFAULT_PREFIXES 3000
+#define LPM_DEFAULT_LOOKUPS 20000
+
+// Examples printed per check
+#define LPM_EXAMPLES 5
+
+/*
+ * The checks, one failure counter each
+ */
+enum lpm_check {
+    LPM_CIDR_PARSE,  // parse_ipv4_cidr() against the reference rules
+    LPM_CIDR_MATCH,  // ipv4_cidr_match_batch() against ipv4_cidr_contains()
+    LPM_BUILD,       // Table loaded with ipv4_lpm_build()
+    LPM_ADD,         // Table loaded with ipv4_lpm_add()
+    LPM_BATCH,       // ipv4_lpm_lookup_batch() on the built table
+    LPM_LIMITS,      // Rejected values, prefix lengths and exhausted extension groups
+    LPM_CHECK_COUNT
+};
+
+static const char* const lpm_check_names[LPM_CHECK_COUNT] = {
+    "cidr_parse", "cidr_match", "lpm_build", "lpm_add", "lpm_batch", "lpm_limits",
+};
+
+static uint64_t lpm_failures[LPM_CHECK_COUNT];
+
+// splitmix64, so each round is reproducible from its seed
+static uint64_t lpm_state;
+
+static uint64_t lpm_next(void) {
+    lpm_state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = lpm_state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Counts a failure and prints it if it is one of the first few for that check
+static void lpm_fail(enum lpm_check check, const char* what, uint32_t addr) {
+    if (lpm_failures[check]++ < LPM_EXAMPLES) {
+        fprintf(stderr, "%s disagrees on %s %u.%u.%u.%u\n", lpm_check_names[check], what,
+                addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF);
+    }
+}
+
+static uint32_t lpm_mask(unsigned prefix) {
+    return prefix != 0 ? 0xFFFFFFFFu << (32 - prefix) : 0;
+}
+
+/*
+ * parse_ipv4_cidr() rules written out directly: the address before the first
+ * '/' must pass parse_ipv4_scalar() (which validate-ip-diff holds to the
+ * original validate_ip()), the rest must be a 1-2 digit decimal 0-32 without
+ * a leading zero
+ */
+static int reference_cidr(const char* p, size_t n, struct ipv4_cidr* out) {
+    const char* slash = memchr(p, '/', n);
+    uint32_t addr = 0;
+    if (slash == NULL || !parse_ipv4_scalar(p, (size_t)(slash - p), &addr)) {
+        return 0;
+    }
+    const char* d = slash + 1;
+    size_t count = n - (size_t)(d - p);
+    if (count < 1 || count > 2) {
+        return 0;
+    }
+    unsigned prefix = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (d[i] < '0' || d[i] > '9') {
+            return 0;
+        }
+        prefix = prefix * 10 + (unsigned)(d[i] - '0');
+    }
+    if ((count == 2 && d[0] == '0') || prefix > 32) {
+        return 0;
+    }
+    out->prefix = prefix;
+    out->mask = lpm_mask(prefix);
+    out->network = addr & out->mask;
+    return 1;
+}
+
+// Runs one text form through parse_ipv4_cidr() and the reference
+static int lpm_parse(const char* text, size_t n, struct ipv4_cidr* out) {
+    struct ipv4_cidr got, want;
+    int ok = parse_ipv4_cidr(text, n, &got);
+    int expect = reference_cidr(text, n, &want);
+    if (ok != expect || (ok && (got.network != want.network || got.mask != want.mask ||
+                                got.prefix != want.prefix))) {
+        if (lpm_failures[LPM_CIDR_PARSE]++ < LPM_EXAMPLES) {
+            fprintf(stderr, "cidr_parse disagrees on \"%.*s\"\n", (int)n, text);
+        }
+        return 0;
+    }
+    if (ok && out != NULL) {
+        *out = got;
+    }
+    return ok;
+}
+
+// A few malformed variants of a block's text form, each only checked against the reference
+static void lpm_parse_mutations(const char* text, size_t n) {
+    static const char* const tails[] = {"/", "/33", "/08", "/123", "/-1", "/ 8", "/8 ", "/8/8", ""};
+    char buf[48];
+    const char* slash = memchr(text, '/', n);
+    size_t head = (size_t)(slash - text);
+    for (size_t t = 0; t < sizeof(tails) / sizeof(tails[0]); t++) {
+        int len = snprintf(buf, sizeof(buf), "%.*s%s", (int)head, text, tails[t]);
+        lpm_parse(buf, (size_t)len, NULL);
+    }
+    // A leading zero in the address part, and the whole form cut short
+    int len = snprintf(buf, sizeof(buf), "0%.*s", (int)n, text);
+    lpm_parse(buf, (size_t)len, NULL);
+    lpm_parse(text, n - 1, NULL);
+}
+
+/*
+ * Draws prefix number i of a round into *block and values[i]. Earlier
+ * prefixes of blocks may be reused for clusters and duplicates.
+ */
+static void lpm_draw(struct ipv4_cidr* blocks, uint32_t* values, size_t i, const uint32_t* clusters) {
+    uint64_t r = lpm_next();
+    values[i] = (uint32_t)(r >> 40) & IPV4_LPM_MAX_VALUE;
+    uint32_t addr = (uint32_t)lpm_next();
+    unsigned prefix;
+
+    switch (r % 16) {
+    case 0:  // Duplicate of an earlier prefix with a new value
+        if (i > 0) {
+            blocks[i] = blocks[(r >> 8) % i];
+            return;
+        }
+        prefix = 8;
+        break;
+    case 1:
+        prefix = 32;
+        break;
+    case 2:
+    case 3:
+    case 4:  // Long prefix inside one of the cluster /24s (some with host bits left set below)
+        addr = clusters[(r >> 8) % 4] | (addr & 0xFF);
+        prefix = 25 + (unsigned)((r >> 16) % 8);
+        break;
+    case 5:  // Short prefix over the cluster /24s, arriving after some of their long ones
+        addr = clusters[(r >> 8) % 4];
+        prefix = 8 + (unsigned)((r >> 16) % 17);
+        break;
+    default:
+        prefix = (unsigned)((r >> 16) % 33);
+        break;
+    }
+
+    // Most blocks come from text; the rest are filled in by hand with host bits set
+    if ((r >> 24) % 8 != 0) {
+        char text[24];
+        int len = snprintf(text, sizeof(text), "%u.%u.%u.%u/%u", addr >> 24, (addr >> 16) & 0xFF,
+                           (addr >> 8) & 0xFF, addr & 0xFF, prefix);
+        if (!lpm_parse(text, (size_t)len, &blocks[i])) {
+            blocks[i].prefix = prefix;  // Reported; keep the round going with the intended block
+            blocks[i].mask = lpm_mask(prefix);
+            blocks[i].network = addr & blocks[i].mask;
+        }
+        if ((r >> 28) % 16 == 0) {
+            lpm_parse_mutations(text, (size_t)len);
+        }
+    } else {
+        blocks[i].prefix = prefix;
+        blocks[i].mask = lpm_mask(prefix);
+        blocks[i].network = addr;
+    }
+}
+
+// Linear longest-match scan: the longest prefix containing addr, the last of equal ones
+static int reference_lookup(const struct ipv4_cidr* blocks, const uint32_t* values, size_t n,
+                            uint32_t addr, uint32_t* value) {
+    int best = -1;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t mask = lpm_mask(blocks[i].prefix);
+        if ((addr & mask) == (blocks[i].network & mask) && (int)blocks[i].prefix >= best) {
+            best = (int)blocks[i].prefix;
+            *value = values[i];
+        }
+    }
+    return best >= 0;
+}
+
+// Addresses to look up: random ones, and the edges of the prefixes in the set
+static void lpm_addresses(uint32_t* addrs, size_t count, const struct ipv4_cidr* blocks, size_t n) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t r = lpm_next();
+        if (r % 2 == 0 || n == 0) {
+            addrs[i] = (uint32_t)(r >> 32);
+            continue;
+        }
+        const struct ipv4_cidr* b = &blocks[(r >> 8) % n];
+        uint32_t mask = lpm_mask(b->prefix);
+        uint32_t network = b->network & mask;
+        switch ((r >> 4) % 5) {
+        case 0:
+            addrs[i] = network;
+            break;
+        case 1:
+            addrs[i] = network - 1;
+            break;
+        case 2:
+            addrs[i] = network | ~mask;
+            break;
+        case 3:
+            addrs[i] = (network | ~mask) + 1;
+            break;
+        default:
+            addrs[i] = network | ((uint32_t)(r >> 32) & ~mask);
+            break;
+        }
+    }
+}
+
+// Compares ipv4_cidr_match_batch() with ipv4_cidr_contains() over addrs at one length
+static void lpm_check_match(const struct ipv4_cidr* block, const uint32_t* addrs, size_t n,
+                            uint8_t* bitmap) {
+    memset(bitmap, 0xFF, (n + 7) / 8);
+    size_t matches = ipv4_cidr_match_batch(block, addrs, n, bitmap);
+    size_t expect = 0;
+    for (size_t i = 0; i < n; i++) {
+        int in = (addrs[i] & block->mask) == block->network;
+        expect += (size_t)in;
+        if (((bitmap[i / 8] >> (i % 8)) & 1) != in || ipv4_cidr_contains(block, addrs[i]) != in) {
+            lpm_fail(LPM_CIDR_MATCH, "address", addrs[i]);
+        }
+    }
+    if (n % 8 != 0 && (bitmap[n / 8] >> (n % 8)) != 0) {
+        lpm_fail(LPM_CIDR_MATCH, "unused bitmap bits for block", block->network);
+    }
+    if (matches != expect) {
+        lpm_fail(LPM_CIDR_MATCH, "match count for block", block->network);
+    }
+}
+
+// The rejections ipv4_lpm_add() documents, on a table of its own
+static void lpm_check_limits(void) {
+    struct ipv4_lpm* lpm = ipv4_lpm_create(1);
+    if (lpm == NULL) {
+        fprintf(stderr, "validate-ip-lpm: out of memory\n");
+        exit(1);
+    }
+    struct ipv4_cidr first = {0x0A000080, 0xFFFFFF80, 25};
+    struct ipv4_cidr second = {0x0A000180, 0xFFFFFF80, 25};  // Another /24: needs a second group
+    struct ipv4_cidr too_long = {0x0A000000, 0xFFFFFFFF, 33};
+    uint32_t value = 0;
+    if (ipv4_lpm_add(lpm, &first, IPV4_LPM_MAX_VALUE + 1) != 0 ||
+        ipv4_lpm_add(lpm, &too_long, 1) != 0 ||
+        ipv4_lpm_add(lpm, &first, IPV4_LPM_MAX_VALUE) != 1 ||
+        ipv4_lpm_add(lpm, &second, 2) != 0 ||
+        !ipv4_lpm_lookup(lpm, 0x0A0000FF, &value) || value != IPV4_LPM_MAX_VALUE ||
+        ipv4_lpm_lookup(lpm, 0x0A0001FF, &value) || ipv4_lpm_lookup(lpm, 0x0A00007F, &value)) {
+        lpm_fail(LPM_LIMITS, "rejections around", first.network);
+    }
+    ipv4_lpm_free(lpm);
+    if (ipv4_lpm_create(IPV4_LPM_MAX_VALUE + 2) != NULL) {
+        lpm_fail(LPM_LIMITS, "group count", 0);
+    }
+}
+
+// Runs one round with n prefixes and lookups addresses
+static void lpm_round(size_t n, size_t lookups) {
+    struct ipv4_cidr* blocks = malloc((n + 1) * sizeof(*blocks));
+    uint32_t* values = malloc((n + 1) * sizeof(*values));
+    uint32_t* addrs = malloc(lookups * sizeof(*addrs) + 1);
+    uint32_t* got = malloc(lookups * sizeof(*got) + 1);
+    uint8_t* found = malloc(lookups / 8 + 1);
+    struct ipv4_lpm* built = ipv4_lpm_create((uint32_t)n);
+    struct ipv4_lpm* added = ipv4_lpm_create((uint32_t)n);
+    if (blocks == NULL || values == NULL || addrs == NULL || got == NULL || found == NULL ||
+        built == NULL || added == NULL) {
+        fprintf(stderr, "validate-ip-lpm: out of memory\n");
+        exit(1);
+    }
+
+    uint32_t clusters[4];
+    for (int c = 0; c < 4; c++) {
+        clusters[c] = (uint32_t)lpm_next() & 0xFFFFFF00u;
+    }
+    for (size_t i = 0; i < n; i++) {
+        lpm_draw(blocks, values, i, clusters);
+    }
+    // Every other round covers the whole space with a /0 somewhere in the middle
+    if (lpm_next() % 2 == 0 && n > 0) {
+        size_t at = n / 2;
+        blocks[at].prefix = 0;
+        blocks[at].mask = 0;
+        blocks[at].network = (uint32_t)lpm_next();  // All host bits, none of them used
+    }
+
+    if (ipv4_lpm_build(built, blocks, values, n) != n) {
+        lpm_fail(LPM_BUILD, "prefix count, first", blocks[0].network);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!ipv4_lpm_add(added, &blocks[i], values[i])) {
+            lpm_fail(LPM_ADD, "insert of", blocks[i].network);
+        }
+    }
+
+    lpm_addresses(addrs, lookups, blocks, n);
+    size_t expect_found = 0;
+    memset(found, 0xFF, lookups / 8 + 1);
+    size_t batch_found = ipv4_lpm_lookup_batch(built, addrs, lookups, found, got);
+    for (size_t i = 0; i < lookups; i++) {
+        uint32_t want = 0, value = 0;
+        int expect = reference_lookup(blocks, values, n, addrs[i], &want);
+        expect_found += (size_t)expect;
+        int ok = ipv4_lpm_lookup(built, addrs[i], &value);
+        if (ok != expect || (expect && value != want)) {
+            lpm_fail(LPM_BUILD, "address", addrs[i]);
+        }
+        value = 0;
+        ok = ipv4_lpm_lookup(added, addrs[i], &value);
+        if (ok != expect || (expect && value != want)) {
+            lpm_fail(LPM_ADD, "address", addrs[i]);
+        }
+        if (((found[i / 8] >> (i % 8)) & 1) != expect || got[i] != (expect ? want : 0)) {
+            lpm_fail(LPM_BATCH, "address", addrs[i]);
+        }
+    }
+    if (batch_found != expect_found ||
+        ipv4_lpm_lookup_batch(built, addrs, lookups, NULL, NULL) != expect_found) {
+        lpm_fail(LPM_BATCH, "match count, first address", lookups > 0 ? addrs[0] : 0);
+    }
+
+    // Membership over the same addresses, for a few blocks including the /0 and /32 ones
+    for (int k = 0; k < 6 && n > 0; k++) {
+        struct ipv4_cidr block = blocks[lpm_next() % n];
+        if (k == 0) {
+            block.prefix = 0;
+        } else if (k == 1) {
+            block.prefix = 32;
+        }
+        block.mask = lpm_mask(block.prefix);
+        block.network &= block.mask;
+        for (size_t len = 0; len <= 40 && (size_t)k + len <= lookups; len++) {
+            lpm_check_match(&block, addrs + k, len, found);  // Odd starts and every tail length
+        }
+        lpm_check_match(&block, addrs, lookups, found);
+    }
+
+    ipv4_lpm_free(built);
+    ipv4_lpm_free(added);
+    free(blocks);
+    free(values);
+    free(addrs);
+    free(got);
+    free(found);
+}
+
+static void print_usage(FILE* f) {
+    fprintf(f,
+            "Usage: validate-ip-lpm [--rounds N] [--prefixes N] [--lookups N] [--seed N]\n"
+            "\n"
+            "  --rounds N    prefix sets to check (default %d)\n"
+            "  --prefixes N  prefixes per set (default %d)\n"
+            "  --lookups N   addresses looked up per set (default %d)\n"
+            "  --seed N      first round's seed, to replay a run (default 1)\n",
+            LPM_DEFAULT_ROUNDS, LPM_DEFAULT_PREFIXES, LPM_DEFAULT_LOOKUPS);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long long rounds = LPM_DEFAULT_ROUNDS, prefixes = LPM_DEFAULT_PREFIXES;
+    unsigned long long lookups = LPM_DEFAULT_LOOKUPS, seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        unsigned long long* target = strcmp(arg, "--rounds") == 0     ? &rounds
+                                   : strcmp(arg, "--prefixes") == 0   ? &prefixes
+                                   : strcmp(arg, "--lookups") == 0    ? &lookups
+                                   : strcmp(arg, "--seed") == 0       ? &seed
+                                                                      : NULL;
+        char* end = NULL;
+        if (target == NULL || i + 1 >= argc) {
+            int help = strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0;
+            print_usage(help ? stdout : stderr);
+            return help ? 0 : 2;
+        }
+        *target = strtoull(argv[++i], &end, 10);
+        if (*end != '\0' || (target == &prefixes && *target > IPV4_LPM_MAX_VALUE)) {
+            print_usage(stderr);
+            return 2;
+        }
+    }
+
+    lpm_check_limits();
+    for (unsigned long long r = 0; r < rounds; r++) {
+        lpm_state = (seed + r) * 0xD1B54A32D192ED03ULL;
+        lpm_round((size_t)prefixes, (size_t)lookups);
+    }
+
+    printf("rounds %llu, prefixes %llu, lookups %llu, seed %llu\n", rounds, prefixes, lookups, seed);
+    int status = 0;
+    for (int c = 0; c < LPM_CHECK_COUNT; c++) {
+        printf("%-14s %llu\n", lpm_check_names[c], (unsigned long long)lpm_failures[c]);
+        status |= lpm_failures[c] != 0;
+    }
+    return status;
+}
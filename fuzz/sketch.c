@@ -0,0 +1,383 @@
+/*
+ * Exact-count check for the aggregation sketches
+ *
+ * Feeds a few address streams with very different shapes into struct
+ * ipv4_topk and struct ipv4_hll and compares them with exact counts taken
+ * from a sorted copy of the stream:
+ *
+ *   few       fewer distinct addresses than counters, so every count is exact
+ *   uniform   a million addresses seen about twice each, evicting on almost every add
+ *   skewed    a log-uniform rank distribution with a long tail
+ *   heavy     twenty addresses at about 1% each over uniform noise
+ *   churn     a cycle over twice the counters, plus one address every 600th item
+ *
+ * For every stream each reported count must satisfy count - error <= true <=
+ * count, every address seen more than N / IPV4_TOPK_CAPACITY times must be
+ * reported, and the counts must add up to N. The internal layout is checked
+ * as the stream goes: counters sorted, runs of equal counts consistent, and
+ * every counter reachable in the lookup table from its home slot, which is
+ * what the backshift in ipv4_topk_unlink() has to preserve. The stream is
+ * then split into shards that are merged: the HyperLogLog registers must come
+ * out identical to one sketch over everything, and the merged top-K must keep
+ * the bounds, with every address above 2N / IPV4_TOPK_CAPACITY present (the
+ * merge can double the total of the counts, see ipv4_topk_merge()).
+ *
+ * HyperLogLog estimates are compared with the true count at cardinalities
+ * from 10 to 10^7.
+ *
+ * Build and run with: make sketch
+ */
+#include "../validate-ip.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Items per stream
+#define SKETCH_STREAM (1u << 21)
+
+// Shards each stream is split into for the merge checks
+#define SKETCH_SHARDS 4
+
+// Items between two layout checks
+#define SKETCH_CHECK_EVERY 997
+
+// Allowed HyperLogLog error: four standard errors of 1.04 / sqrt(registers)
+#define SKETCH_HLL_TOLERANCE (4 * 1.04 / 128.0)
+
+// Examples printed per check
+#define SKETCH_EXAMPLES 5
+
+/*
+ * The checks, one failure counter each
+ */
+enum sketch_check {
+    SKETCH_BOUND,     // count - error <= true <= count
+    SKETCH_PRESENT,   // Frequent addresses are reported
+    SKETCH_EXACT,     // Exact counts while nothing was evicted, and the total
+    SKETCH_LAYOUT,    // Sorted counters, runs and lookup table
+    SKETCH_MERGE,     // Merged top-K bounds and presence, merging an empty sketch
+    SKETCH_HLL,       // Estimate error, and that duplicates do not change registers
+    SKETCH_HLL_MERGE, // Merged registers equal one sketch over everything
+    SKETCH_CHECK_COUNT
+};
+
+static const char* const sketch_check_names[SKETCH_CHECK_COUNT] = {
+    "topk_bound", "topk_present", "topk_exact", "topk_layout", "topk_merge", "hll", "hll_merge",
+};
+
+static uint64_t sketch_failures[SKETCH_CHECK_COUNT];
+
+// splitmix64, so every run sees the same streams
+static uint64_t sketch_state = 1;
+
+static uint64_t sketch_next(void) {
+    sketch_state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = sketch_state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Counts a failure and prints it if it is one of the first few for that check
+static void sketch_fail(enum sketch_check check, const char* stream, const char* what,
+                        uint64_t a, uint64_t b) {
+    if (sketch_failures[check]++ < SKETCH_EXAMPLES) {
+        fprintf(stderr, "%s fails on %s: %s (%llu, %llu)\n", sketch_check_names[check], stream,
+                what, (unsigned long long)a, (unsigned long long)b);
+    }
+}
+
+// Spreads small key numbers over the address space (odd multiplier, so still one-to-one)
+static uint32_t sketch_addr(uint32_t key) {
+    return key * 0x2545F491u + 0x0A000000u;
+}
+
+static int sketch_compare(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// True count of addr in the sorted stream
+static uint64_t sketch_true(const uint32_t* sorted, size_t n, uint32_t addr) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted[mid] < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t end = lo;
+    while (end < n && sorted[end] == addr) {
+        end++;
+    }
+    return end - lo;
+}
+
+// Home slot of addr in the lookup table, as ipv4_topk_home() computes it
+static size_t sketch_home(uint32_t addr) {
+    return (size_t)(((uint64_t)addr * 0x9E3779B97F4A7C15ull) >> 40) & (2 * IPV4_TOPK_CAPACITY - 1);
+}
+
+// Checks the stream-summary layout of a sketch
+static void sketch_check_layout(const struct ipv4_topk* t, const char* stream) {
+    const size_t mask = 2 * IPV4_TOPK_CAPACITY - 1;
+    size_t used = 0, runs = 0;
+    for (size_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        const struct ipv4_topk_entry* e = &t->counters[i];
+        if (i > 0 && t->counters[i - 1].count > e->count) {
+            sketch_fail(SKETCH_LAYOUT, stream, "counters out of order at", i, e->count);
+        }
+
+        // Runs: counter i is inside its run, which covers exactly the counters with its count
+        uint16_t r = t->run[i];
+        size_t first = t->run_first[r], last = t->run_last[r];
+        if (first > i || i > last || t->counters[first].count != e->count ||
+            t->counters[last].count != e->count ||
+            (first > 0 && t->counters[first - 1].count == e->count) ||
+            (last + 1 < IPV4_TOPK_CAPACITY && t->counters[last + 1].count == e->count)) {
+            sketch_fail(SKETCH_LAYOUT, stream, "run of counter", i, r);
+        }
+        runs += first == i;
+
+        if (e->count == 0) {
+            continue;
+        }
+        used++;
+
+        // Lookup table: the counter's slot points back at it and is reached from the home slot
+        size_t s = t->slot[i];
+        if (t->index[s] != i + 1) {
+            sketch_fail(SKETCH_LAYOUT, stream, "table slot of counter", i, s);
+            continue;
+        }
+        for (size_t p = sketch_home(e->addr); p != s; p = (p + 1) & mask) {
+            if (t->index[p] == 0) {
+                sketch_fail(SKETCH_LAYOUT, stream, "gap before the slot of counter", i, p);
+                break;
+            }
+        }
+    }
+    size_t filled = 0;
+    for (size_t s = 0; s <= mask; s++) {
+        filled += t->index[s] != 0;
+    }
+    if (filled != used || runs + t->free_count != IPV4_TOPK_CAPACITY) {
+        sketch_fail(SKETCH_LAYOUT, stream, "table entries or free runs", filled, runs + t->free_count);
+    }
+}
+
+/*
+ * Checks a sketch of n items against the sorted stream: the bounds of every
+ * reported count, and that every address seen more than present_above times
+ * is reported
+ */
+static void sketch_check_counts(const struct ipv4_topk* t, const uint32_t* sorted, size_t n,
+                                uint64_t present_above, enum sketch_check check,
+                                const char* stream) {
+    static struct ipv4_topk_entry out[IPV4_TOPK_CAPACITY];
+    size_t k = ipv4_topk_result(t, out, IPV4_TOPK_CAPACITY);
+    for (size_t i = 0; i < k; i++) {
+        uint64_t truth = sketch_true(sorted, n, out[i].addr);
+        if (out[i].error > out[i].count || out[i].count - out[i].error > truth ||
+            truth > out[i].count) {
+            sketch_fail(check == SKETCH_MERGE ? SKETCH_MERGE : SKETCH_BOUND, stream,
+                        "count and true count", out[i].count, truth);
+        }
+        if (i > 0 && out[i - 1].count < out[i].count) {
+            sketch_fail(check, stream, "result out of order at", i, out[i].count);
+        }
+    }
+
+    // Walk the distinct addresses of the stream; the frequent ones must be in the result
+    for (size_t i = 0; i < n; ) {
+        size_t end = i;
+        while (end < n && sorted[end] == sorted[i]) {
+            end++;
+        }
+        if (end - i > present_above) {
+            size_t j = 0;
+            while (j < k && out[j].addr != sorted[i]) {
+                j++;
+            }
+            if (j == k) {
+                sketch_fail(check == SKETCH_MERGE ? SKETCH_MERGE : SKETCH_PRESENT, stream,
+                            "missing address seen", end - i, present_above);
+            }
+        }
+        i = end;
+    }
+}
+
+// Fills stream with n items of the named shape
+static void sketch_fill(const char* shape, uint32_t* stream, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = sketch_next();
+        uint32_t key;
+        if (strcmp(shape, "few") == 0) {
+            key = (uint32_t)(r % 500);
+        } else if (strcmp(shape, "uniform") == 0) {
+            key = (uint32_t)(r % (1u << 20));
+        } else if (strcmp(shape, "skewed") == 0) {
+            double u = (double)(r >> 11) / 9007199254740992.0;
+            key = (uint32_t)exp(u * log((double)(1u << 20)));
+        } else if (strcmp(shape, "heavy") == 0) {
+            key = r % 100 < 20 ? (uint32_t)(r >> 32) % 20 : (uint32_t)(r >> 32);
+        } else {
+            key = i % 600 == 0 ? 0xFFFFFFFFu : (uint32_t)(i % (2 * IPV4_TOPK_CAPACITY));
+        }
+        stream[i] = sketch_addr(key);
+    }
+}
+
+// Runs the top-K and HyperLogLog checks on one stream shape
+static void sketch_stream(const char* shape, uint32_t* stream, uint32_t* sorted,
+                          struct ipv4_topk* shards, struct ipv4_topk* whole) {
+    const size_t n = SKETCH_STREAM;
+    sketch_fill(shape, stream, n);
+    memcpy(sorted, stream, n * sizeof(*stream));
+    qsort(sorted, n, sizeof(*sorted), sketch_compare);
+    size_t distinct = 0;
+    for (size_t i = 0; i < n; i++) {
+        distinct += i == 0 || sorted[i] != sorted[i - 1];
+    }
+
+    // One sketch over the whole stream, its layout checked as it goes
+    ipv4_topk_init(whole);
+    for (size_t i = 0; i < n; i++) {
+        ipv4_topk_add(whole, stream[i]);
+        if (i % SKETCH_CHECK_EVERY == 0) {
+            sketch_check_layout(whole, shape);
+        }
+    }
+    sketch_check_layout(whole, shape);
+    sketch_check_counts(whole, sorted, n, n / IPV4_TOPK_CAPACITY, SKETCH_BOUND, shape);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        const struct ipv4_topk_entry* e = &whole->counters[i];
+        total += e->count;
+        if (distinct <= IPV4_TOPK_CAPACITY && e->count != 0 &&
+            (e->error != 0 || e->count != sketch_true(sorted, n, e->addr))) {
+            sketch_fail(SKETCH_EXACT, shape, "inexact count without evictions", e->count, e->error);
+        }
+    }
+    if (total != n) {
+        sketch_fail(SKETCH_EXACT, shape, "counts add up to", total, n);
+    }
+
+    // Contiguous shards merged into the first; the merged counts keep the bounds
+    struct ipv4_hll* hll = malloc((SKETCH_SHARDS + 1) * sizeof(*hll));
+    if (hll == NULL) {
+        fprintf(stderr, "validate-ip-sketch: out of memory\n");
+        exit(1);
+    }
+    ipv4_hll_init(&hll[SKETCH_SHARDS]);
+    for (int s = 0; s < SKETCH_SHARDS; s++) {
+        ipv4_topk_init(&shards[s]);
+        ipv4_hll_init(&hll[s]);
+        for (size_t i = n * (size_t)s / SKETCH_SHARDS; i < n * (size_t)(s + 1) / SKETCH_SHARDS; i++) {
+            ipv4_topk_add(&shards[s], stream[i]);
+            ipv4_hll_add(&hll[s], stream[i]);
+            ipv4_hll_add(&hll[SKETCH_SHARDS], stream[i]);
+        }
+    }
+    for (int s = 1; s < SKETCH_SHARDS; s++) {
+        ipv4_topk_merge(&shards[0], &shards[s]);
+        ipv4_hll_merge(&hll[0], &hll[s]);
+    }
+    sketch_check_layout(&shards[0], shape);
+    sketch_check_counts(&shards[0], sorted, n, 2 * n / IPV4_TOPK_CAPACITY, SKETCH_MERGE, shape);
+    if (memcmp(&hll[0], &hll[SKETCH_SHARDS], sizeof(hll[0])) != 0) {
+        sketch_fail(SKETCH_HLL_MERGE, shape, "merged registers differ, distinct", distinct, 0);
+    }
+    uint64_t estimate = ipv4_hll_count(&hll[0]);
+    if (fabs((double)estimate - (double)distinct) > SKETCH_HLL_TOLERANCE * (double)distinct + 2) {
+        sketch_fail(SKETCH_HLL, shape, "estimate and distinct", estimate, distinct);
+    }
+
+    // Merging an empty sketch, either way round, keeps every counter as it was
+    static struct {
+        struct ipv4_topk_entry before[IPV4_TOPK_CAPACITY], after[IPV4_TOPK_CAPACITY];
+    } r;
+    size_t k = ipv4_topk_result(whole, r.before, IPV4_TOPK_CAPACITY);
+    ipv4_topk_init(&shards[1]);
+    ipv4_topk_merge(whole, &shards[1]);
+    ipv4_topk_merge(&shards[1], whole);
+    for (int side = 0; side < 2; side++) {
+        const struct ipv4_topk* t = side == 0 ? whole : &shards[1];
+        size_t got = ipv4_topk_result(t, r.after, IPV4_TOPK_CAPACITY);
+        if (got != k || memcmp(r.before, r.after, k * sizeof(r.before[0])) != 0) {
+            sketch_fail(SKETCH_MERGE, shape, "merge with an empty sketch changed counters", got, k);
+        }
+        sketch_check_layout(t, shape);
+    }
+    free(hll);
+}
+
+// HyperLogLog estimate of n distinct addresses, each added twice
+static void sketch_hll_cardinality(uint64_t n) {
+    struct ipv4_hll* hll = malloc(2 * sizeof(*hll));
+    if (hll == NULL) {
+        fprintf(stderr, "validate-ip-sketch: out of memory\n");
+        exit(1);
+    }
+    ipv4_hll_init(&hll[0]);
+    ipv4_hll_init(&hll[1]);
+    for (uint64_t i = 0; i < n; i++) {
+        ipv4_hll_add(&hll[0], sketch_addr((uint32_t)i));
+        ipv4_hll_add(&hll[1], sketch_addr((uint32_t)i));
+        ipv4_hll_add(&hll[1], sketch_addr((uint32_t)i));
+    }
+    uint64_t estimate = ipv4_hll_count(&hll[0]);
+    double error = ((double)estimate - (double)n) / (double)n;
+    printf("hll %-10llu estimate %-10llu error %+.3f%%\n", (unsigned long long)n,
+           (unsigned long long)estimate, 100.0 * error);
+    if (fabs(error) > SKETCH_HLL_TOLERANCE) {
+        sketch_fail(SKETCH_HLL, "cardinality", "estimate and distinct", estimate, n);
+    }
+    if (memcmp(&hll[0], &hll[1], sizeof(hll[0])) != 0) {
+        sketch_fail(SKETCH_HLL, "cardinality", "duplicates changed registers", n, 0);
+    }
+    free(hll);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        int help = strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0;
+        fprintf(help ? stdout : stderr, "Usage: validate-ip-sketch\n");
+        return help ? 0 : 2;
+    }
+
+    uint32_t* stream = malloc(SKETCH_STREAM * sizeof(*stream));
+    uint32_t* sorted = malloc(SKETCH_STREAM * sizeof(*sorted));
+    struct ipv4_topk* shards = malloc(SKETCH_SHARDS * sizeof(*shards));
+    struct ipv4_topk* whole = malloc(sizeof(*whole));
+    if (stream == NULL || sorted == NULL || shards == NULL || whole == NULL) {
+        fprintf(stderr, "validate-ip-sketch: out of memory\n");
+        return 1;
+    }
+
+    static const char* const shapes[] = {"few", "uniform", "skewed", "heavy", "churn"};
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        sketch_stream(shapes[s], stream, sorted, shards, whole);
+    }
+    for (uint64_t n = 10; n <= 10000000; n *= 10) {
+        sketch_hll_cardinality(n);
+    }
+    free(stream);
+    free(sorted);
+    free(shards);
+    free(whole);
+
+    int status = 0;
+    for (int c = 0; c < SKETCH_CHECK_COUNT; c++) {
+        printf("%-14s %llu\n", sketch_check_names[c], (unsigned long long)sketch_failures[c]);
+        status |= sketch_failures[c] != 0;
+    }
+    return status;
+}
@@ -1,195 +1,3181 @@
+#include "validate-ip.h"
+
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
- * Function: validate_ip
- * Purpose: Validates whether a given string represents a valid IPv4 address
+ * Function: parse_ipv4_scalar
+ * Purpose: Validates and decodes an IPv4 address in a single left-to-right scan
  * 
- * IPv4 Address Format Requirements:
- * - Must contain exactly 4 octets (numbers) separated by 3 dots
- * - Each octet must be a number between 0 and 255 (inclusive)
- * - No leading zeros allowed (except for the number "0" itself)
- * - Only digits and dots are permitted characters
- * - Total length must be between 7 and 15 characters
+ * Accepts exactly the same inputs as validate_ip(): 4 octets separated by 3
+ * dots, each octet 0-255 with no leading zeros, only digits and dots, total
+ * length 7-15 characters. Unlike the original strtok()-based version it never
+ * copies the input, never calls strlen(), atoi() or sprintf(), and looks at
+ * each character exactly once.
+ * This is the portable reference engine the faster ones are checked against.
  * 
- * Parameter: ip - pointer to null-terminated string containing the IP address to validate
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid, may be NULL. The first
+ *                  octet lands in the most significant byte (network order), so
+ *                  "192.168.1.1" becomes 0xC0A80101. Left untouched when invalid.
  * Returns: 1 if valid IPv4 address, 0 if invalid
  */
-int validate_ip(const char* ip) {
-    // First safety check: ensure the input pointer is not NULL
-    // This prevents segmentation faults when accessing the string
+int parse_ipv4_scalar(const char* ip, size_t len, uint32_t* out) {
+    // Safety check: ensure the input pointer is not NULL
     if (ip == NULL) {
         return 0;  // Invalid: null pointer means no string to validate
     }
     
-    // Create a buffer to hold a copy of the input string
-    // IPv4 addresses have a maximum length of 15 characters: "255.255.255.255"
-    char ip_copy[16];
-    int len = strlen(ip);  // Get the length of the input string
-    
-    // Validate the overall length of the input string
+    // Validate the overall length before touching any characters
     // Minimum valid IPv4: "0.0.0.0" (7 characters)
     // Maximum valid IPv4: "255.255.255.255" (15 characters)
     if (len < 7 || len > 15) {
-        return 0;  // Invalid: string length is outside acceptable bounds
+        return 0;  // Invalid: length is outside acceptable bounds
     }
     
-    // Create a working copy of the input string because strtok() modifies the original
-    // This preserves the original string for the caller
-    strcpy(ip_copy, ip);
+    uint32_t addr = 0;      // Octets completed so far, packed most significant first
+    unsigned octet = 0;     // Value of the octet currently being read
+    unsigned digits = 0;    // Number of digits seen in the current octet
+    unsigned dot_count = 0; // Number of dots seen so far (must end up as exactly 3)
     
-    // Initialize counter for dots in the IP address
-    // A valid IPv4 address must have exactly 3 dots
-    int dot_count = 0;
-    char* token;      // Pointer to hold each parsed octet
-    char* ptr = ip_copy;  // Pointer to our working copy of the string
-    
-    // First pass: Count dots and validate that only digits and dots are present
-    // This preliminary check catches obvious format errors early
-    for (int i = 0; i < len; i++) {
-        if (ip[i] == '.') {
-            dot_count++;  // Count each dot we encounter
-        } else if (!isdigit(ip[i])) {
-            // If character is not a digit and not a dot, the IP is invalid
-            return 0;  // Invalid: contains non-digit, non-dot character
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)ip[i];
+        
+        if (c == '.') {
+            // A dot closes the current octet, which must not be empty
+            // This catches ".1.2.3", "1..2.3" and similar inputs
+            if (digits == 0) {
+                return 0;  // Invalid: empty octet found
+            }
+            
+            // More than 3 dots would mean more than 4 octets
+            if (++dot_count > 3) {
+                return 0;  // Invalid: too many dots
+            }
+            
+            // Shift the finished octet into the packed address and start the next one
+            addr = (addr << 8) | octet;
+            octet = 0;
+            digits = 0;
+            continue;
         }
-    }
-    
-    // Check that we have exactly 3 dots (which creates 4 octets)
-    if (dot_count != 3) {
-        return 0;  // Invalid: wrong number of dots (too few or too many octets)
-    }
-    
-    // Second pass: Parse each octet and validate its value
-    // Use strtok to split the string by dots and examine each piece
-    token = strtok(ptr, ".");  // Get the first octet
-    int octet_count = 0;       // Keep track of how many octets we've processed
-    
-    // Process each octet until we've checked all 4 or encounter an error
-    while (token != NULL && octet_count < 4) {
-        // Check for empty octets (which would occur with consecutive dots like "192..1.1")
-        if (strlen(token) == 0) {
-            return 0;  // Invalid: empty octet found
+        
+        // Unsigned subtraction maps everything except '0'..'9' above 9
+        unsigned d = (unsigned)c - '0';
+        if (d > 9) {
+            return 0;  // Invalid: contains non-digit, non-dot character
         }
         
-        // Validate leading zeros rule
-        // Leading zeros are not allowed in IPv4 octets, except for "0" itself
+        // Validate leading zeros rule: a digit may not follow a lone leading '0'
         // Examples: "01", "001", "010" are invalid, but "0" is valid
-        if (strlen(token) > 1 && token[0] == '0') {
+        if (digits == 1 && octet == 0) {
             return 0;  // Invalid: leading zeros not allowed
         }
         
-        // Convert the string token to an integer for range checking
-        int num = atoi(token);
-        
-        // Check if the octet value is within the valid IPv4 range (0-255)
-        if (num < 0 || num > 255) {
+        // Accumulate the octet value and range check it as we go
+        // Without leading zeros, a 4th digit always pushes the value past 255,
+        // so this also bounds each octet to at most 3 digits
+        octet = octet * 10 + d;
+        if (octet > 255) {
             return 0;  // Invalid: octet value is outside the 0-255 range
         }
-        
-        // Additional validation: ensure the conversion was accurate
-        // This catches cases where atoi() might not parse correctly or overflow occurs
-        // Convert the number back to string and compare with original token
-        char temp[4];  // Buffer to hold the converted number as string (max "255")
-        sprintf(temp, "%d", num);
-        if (strcmp(temp, token) != 0) {
-            return 0;  // Invalid: conversion mismatch indicates parsing error
-        }
-        
-        // Move to the next octet
-        token = strtok(NULL, ".");  // Get next token (octet) from the string
-        octet_count++;              // Increment our octet counter
+        digits++;
     }
     
-    // Final validation: ensure we processed exactly 4 octets
-    // This catches cases where there might be fewer than 4 octets
-    if (octet_count != 4) {
-        return 0;  // Invalid: wrong number of octets processed
+    // Final validation: exactly 3 dots and a non-empty last octet ("1.2.3." is invalid)
+    if (dot_count != 3 || digits == 0) {
+        return 0;  // Invalid: wrong number of octets
     }
     
-    // If we've made it through all validations, the IP address is valid
+    // Only publish the result once the whole address is known to be valid
+    if (out != NULL) {
+        *out = (addr << 8) | octet;
+    }
     return 1;  // Valid IPv4 address
 }
 
-/**
- * Function: main
- * Purpose: Interactive program entry point that allows users to input and validate IP addresses
+/*
+ * Table-driven engine
  * 
- * Program Flow:
- * 1. Display welcome message and instructions
- * 2. Prompt user for IP address input
- * 3. Validate the entered IP address
- * 4. Display validation result with helpful feedback
- * 5. Ask user if they want to validate another IP
- * 6. Repeat until user chooses to exit
+ * A deterministic finite automaton over character classes. Its states encode
+ * how far into which octet the parser is and which digits may still follow
+ * without the octet exceeding 255 or gaining a leading zero, so every
+ * character costs one class lookup plus one transition lookup, and all the
+ * checks of validate_ip() fall out of the final state. Both tables together
+ * are under 500 bytes and stay resident in L1.
+ */
+
+// Character classes; 0 is "anything else" so unlisted bytes need no initializer
+enum {
+    IPV4_CLASS_OTHER,    // Any byte that cannot appear in an address
+    IPV4_CLASS_ZERO,     // '0'
+    IPV4_CLASS_ONE,      // '1'
+    IPV4_CLASS_TWO,      // '2'
+    IPV4_CLASS_LOW,      // '3' and '4'
+    IPV4_CLASS_FIVE,     // '5'
+    IPV4_CLASS_HIGH,     // '6' to '9'
+    IPV4_CLASS_DOT,      // '.'
+    IPV4_CLASS_COUNT
+};
+
+static const uint8_t ipv4_class[256] = {
+    ['0'] = IPV4_CLASS_ZERO, ['1'] = IPV4_CLASS_ONE, ['2'] = IPV4_CLASS_TWO,
+    ['3'] = IPV4_CLASS_LOW, ['4'] = IPV4_CLASS_LOW, ['5'] = IPV4_CLASS_FIVE,
+    ['6'] = IPV4_CLASS_HIGH, ['7'] = IPV4_CLASS_HIGH, ['8'] = IPV4_CLASS_HIGH,
+    ['9'] = IPV4_CLASS_HIGH, ['.'] = IPV4_CLASS_DOT,
+};
+
+// Position inside one octet; each of the 4 octets has its own copy of these states
+enum {
+    IPV4_STATE_START,    // Expecting the first digit
+    IPV4_STATE_ANY2,     // Read "1": two more digits of any value may follow
+    IPV4_STATE_TWO,      // Read "2": the next digit decides how much may follow
+    IPV4_STATE_ANY1,     // One more digit of any value may follow
+    IPV4_STATE_MAX5,     // Read "25": only 0-5 may follow
+    IPV4_STATE_DONE,     // No more digits allowed ("0", or three digits read)
+    IPV4_STATES_PER_OCTET
+};
+
+#define IPV4_S(octet, state) ((octet) * IPV4_STATES_PER_OCTET + (state))
+#define IPV4_REJECT IPV4_S(4, 0)
+#define IPV4_DOT(octet) ((octet) < 3 ? IPV4_S((octet) + 1, IPV4_STATE_START) : IPV4_REJECT)
+
+/* Transition rows of one octet, columns in IPV4_CLASS_* order */
+#define IPV4_OCTET_ROWS(k)                                                                  \
+    /* START */ { IPV4_REJECT, IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_ANY2),          \
+                  IPV4_S(k, IPV4_STATE_TWO), IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1), \
+                  IPV4_S(k, IPV4_STATE_ANY1), IPV4_REJECT },                                    \
+    /* ANY2 */  { IPV4_REJECT, IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1),          \
+                  IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1), \
+                  IPV4_S(k, IPV4_STATE_ANY1), IPV4_DOT(k) },                                    \
+    /* TWO */   { IPV4_REJECT, IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1),          \
+                  IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_ANY1), IPV4_S(k, IPV4_STATE_MAX5), \
+                  IPV4_S(k, IPV4_STATE_DONE), IPV4_DOT(k) },                                    \
+    /* ANY1 */  { IPV4_REJECT, IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE),          \
+                  IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE), \
+                  IPV4_S(k, IPV4_STATE_DONE), IPV4_DOT(k) },                                    \
+    /* MAX5 */  { IPV4_REJECT, IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE),          \
+                  IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE), IPV4_S(k, IPV4_STATE_DONE), \
+                  IPV4_REJECT, IPV4_DOT(k) },                                                   \
+    /* DONE */  { IPV4_REJECT, IPV4_REJECT, IPV4_REJECT, IPV4_REJECT, IPV4_REJECT, IPV4_REJECT,   \
+                  IPV4_REJECT, IPV4_DOT(k) }
+
+static const uint8_t ipv4_dfa[IPV4_REJECT + 1][IPV4_CLASS_COUNT] = {
+    IPV4_OCTET_ROWS(0),
+    IPV4_OCTET_ROWS(1),
+    IPV4_OCTET_ROWS(2),
+    IPV4_OCTET_ROWS(3),
+    /* REJECT */ { IPV4_REJECT, IPV4_REJECT, IPV4_REJECT, IPV4_REJECT,
+                   IPV4_REJECT, IPV4_REJECT, IPV4_REJECT, IPV4_REJECT },
+};
+
+/**
+ * Function: parse_ipv4_table
+ * Purpose: Table-driven engine, the fallback of parse_ipv4() without SIMD
  * 
- * Returns: 0 on successful program completion
+ * Runs the automaton above over the candidate while accumulating the octet
+ * values with conditional moves, so there is no per-character branch on what
+ * the character is. Same parameters, result and accept/reject behavior as
+ * parse_ipv4_scalar().
  */
-int main() {
-    // Declare variables for user interaction
-    char ip_input[100];  // Buffer to store user's IP address input (generous size)
-    char choice;         // Variable to store user's yes/no choice for continuing
+int parse_ipv4_table(const char* ip, size_t len, uint32_t* out) {
+    if (ip == NULL || len < 7 || len > 15) {
+        return 0;  // Invalid: null pointer or length outside 7-15
+    }
     
-    // Display program header and welcome information
-    printf("IP Address Validator\n");
-    printf("====================\n\n");
+    unsigned state = IPV4_S(0, IPV4_STATE_START);
+    uint32_t addr = 0;   // Octets completed so far, packed most significant first
+    uint32_t octet = 0;  // Value of the octet currently being read
     
-    // Main program loop - continues until user chooses to exit
-    do {
-        // Prompt user to enter an IP address for validation
-        printf("Enter an IP address to validate: ");
-        
-        // Read user input using fgets() for safe input handling
-        // fgets() is safer than scanf() as it prevents buffer overflow
-        // and handles spaces/special characters better
-        if (fgets(ip_input, sizeof(ip_input), stdin) != NULL) {
-            // Remove the trailing newline character that fgets() includes
-            // This newline comes from the user pressing Enter
-            int len = strlen(ip_input);
-            if (len > 0 && ip_input[len-1] == '\n') {
-                ip_input[len-1] = '\0';  // Replace newline with null terminator
-            }
-            
-            // Call our validation function to check if the IP is valid
-            int result = validate_ip(ip_input);
-            
-            // Display the validation result to the user
-            // Show both the input and whether it's valid or invalid
-            printf("Result: '%s' is %s\n", ip_input, result ? "VALID" : "INVALID");
-            
-            // If the IP is invalid, provide helpful information about the correct format
-            if (!result) {
-                printf("Note: Valid IPv4 format is xxx.xxx.xxx.xxx where each xxx is 0-255\n");
-                printf("      Examples: 192.168.1.1, 10.0.0.1, 255.255.255.0\n");
-                printf("      Invalid examples: 256.1.1.1, 192.168.01.1, 192.168.1\n");
-            }
-        } else {
-            // Handle the case where fgets() fails (unlikely but good practice)
-            printf("Error reading input.\n");
-        }
-        
-        // Ask user if they want to validate another IP address
-        printf("\nDo you want to validate another IP address? (y/n): ");
-        
-        // Read user's choice using scanf with space before %c
-        // The space before %c consumes any whitespace (including newlines)
-        scanf(" %c", &choice);
-        
-        // Consume the remaining newline character left by scanf
-        // This prevents it from interfering with the next fgets() call
-        getchar();
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)ip[i];
+        unsigned cls = ipv4_class[c];
+        state = ipv4_dfa[state][cls];
         
-        // Add spacing for better readability
-        printf("\n");
-        
-    // Continue the loop if user entered 'y' or 'Y' (case-insensitive)
-    } while (choice == 'y' || choice == 'Y');
+        // A dot shifts the finished octet in; a digit extends the current one.
+        // Bytes of any other class already sent the automaton to IPV4_REJECT.
+        int dot = cls == IPV4_CLASS_DOT;
+        addr = dot ? (addr << 8) | octet : addr;
+        octet = dot ? 0 : octet * 10 + (uint32_t)(c - '0');
+    }
+    
+    // Valid only if the last octet has at least one digit and nothing was rejected
+    if (state <= IPV4_S(3, IPV4_STATE_START) || state >= IPV4_REJECT) {
+        return 0;  // Invalid: see the automaton for which rule was broken
+    }
+    if (out != NULL) {
+        *out = (addr << 8) | octet;
+    }
+    return 1;  // Valid IPv4 address
+}
+
+/*
+ * Branchless scalar engine
+ * 
+ * The early-return chain of parse_ipv4_scalar() is cheap when nearly every
+ * input is valid (or nearly every input is not), but on mixed traffic each
+ * of its exits is a coin flip for the branch predictor. This variant does the
+ * same work for every input: it classifies all 16 byte positions at once with
+ * SWAR arithmetic on two 64-bit words, finds the three dots from the
+ * resulting bitmask, decodes the four octets from their positions, and ORs
+ * every rule into one error flag that is only looked at to produce the result.
+ */
+
+// Stands in for the candidate when its length alone already rules it out
+static const char ipv4_zero16[16];
+
+#define IPV4_SWAR_ONES 0x0101010101010101ULL
+#define IPV4_SWAR_HIGH 0x8080808080808080ULL
+
+// Little-endian load, so byte i of the candidate is always bits 8i-8i+7
+static inline uint64_t ipv4_load_le64(const unsigned char* p) {
+    uint64_t w = 0;
+    for (int i = 7; i >= 0; i--) {
+        w = (w << 8) | p[i];
+    }
+    return w;
+}
+
+/*
+ * Brings a 7-15 byte candidate into two little-endian words, zero past len,
+ * for the branchless and vector engines and the dedup cache key. Two loads
+ * that overlap inside the slice cover every length, so no byte at or after
+ * p[len] is read and nothing has to be copied first.
+ */
+static inline void ipv4_load_slice(const char* p, size_t len, uint64_t* lo, uint64_t* hi) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (len >= 8) {
+        // Bytes 0-7, and the last 8 shifted down so byte 8 lands at the bottom
+        uint64_t head, tail;
+        memcpy(&head, p, 8);
+        memcpy(&tail, p + len - 8, 8);
+        *lo = head;
+        *hi = len > 8 ? tail >> (8 * (16 - len)) : 0;
+    } else {
+        // Length 7: bytes 0-3 and 3-6, the shared byte is the same in both
+        uint32_t head, tail;
+        memcpy(&head, p, 4);
+        memcpy(&tail, p + len - 4, 4);
+        *lo = head | (uint64_t)tail << (8 * (len - 4));
+        *hi = 0;
+    }
+#else
+    unsigned char buf[16] = {0};
+    memcpy(buf, p, len);
+    *lo = ipv4_load_le64(buf);
+    *hi = ipv4_load_le64(buf + 8);
+#endif
+}
+
+// Gathers the top bit of each byte of w (all other bits clear) into an 8-bit mask, byte 0 first
+static inline uint32_t ipv4_swar_gather(uint64_t w) {
+    return (uint32_t)(((w >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+// Top bit set in each byte of w that is an ASCII digit
+static inline uint64_t ipv4_swar_digits(uint64_t w) {
+    uint64_t low = w & ~IPV4_SWAR_HIGH;
+    uint64_t ge_0 = (low + (0x80 - '0') * IPV4_SWAR_ONES) & IPV4_SWAR_HIGH;
+    uint64_t gt_9 = (low + (0x80 - '9' - 1) * IPV4_SWAR_ONES) & IPV4_SWAR_HIGH;
+    return ge_0 & ~gt_9 & ~w & IPV4_SWAR_HIGH;
+}
+
+// Top bit set in each byte of w that is a '.'
+static inline uint64_t ipv4_swar_dots(uint64_t w) {
+    uint64_t t = w ^ ('.' * IPV4_SWAR_ONES);
+    uint64_t nonzero = (((t & ~IPV4_SWAR_HIGH) + ~IPV4_SWAR_HIGH) | t) & IPV4_SWAR_HIGH;
+    return ~nonzero & IPV4_SWAR_HIGH;
+}
+
+// Index of the lowest set bit of a nonzero mask
+static inline unsigned ipv4_ctz(uint32_t m) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(m);
+#else
+    unsigned n = 0;
+    for (; !(m & 1); m >>= 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Number of set bits in m
+static inline unsigned ipv4_popcount(uint32_t m) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_popcount(m);
+#else
+    unsigned n = 0;
+    for (; m != 0; m &= m - 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Value of the octet of length len starting at buf[start], all three
+ * candidates computed and the right one picked without a branch. Sets *bad
+ * when the length is not 1-3, the octet has a leading zero or exceeds 255.
+ */
+static inline uint32_t ipv4_branchless_octet(const unsigned char* buf, uint32_t start,
+                                             uint32_t len, uint32_t* bad) {
+    uint32_t one = (uint32_t)(buf[start] - '0');
+    uint32_t two = one * 10 + (uint32_t)(buf[start + 1] - '0');
+    uint32_t three = two * 10 + (uint32_t)(buf[start + 2] - '0');
+    uint32_t value = len >= 3 ? three : len == 2 ? two : one;
+    
+    *bad |= (uint32_t)(len - 1 > 2);                       // Empty or more than 3 digits
+    *bad |= (uint32_t)(len >= 2) & (uint32_t)(one == 0);   // Leading zero
+    *bad |= (uint32_t)(value > 255);                       // Octet above 255
+    return value;
+}
+
+/**
+ * Function: parse_ipv4_branchless
+ * Purpose: Scalar engine without data-dependent branches, for mixed-validity input
+ * 
+ * The candidate is brought into two 64-bit words the same way the dedup
+ * cache builds its key, then mirrored into a zeroed 24-byte buffer, so
+ * positions past len read as '\0' (which is neither a digit nor a dot) and
+ * the octet reads below can never leave the buffer. A real '\0' inside the
+ * candidate is still rejected, because the character check compares against
+ * the exact range [0, len). Same parameters, result and
+ * accept/reject behavior as parse_ipv4_scalar(); *out is written with a
+ * conditional move, so it still keeps its old value when the input is invalid.
+ */
+int parse_ipv4_branchless(const char* ip, size_t len, uint32_t* out) {
+    if (ip == NULL) {
+        return 0;  // Invalid: null pointer means no string to validate
+    }
     
-    // Display goodbye message when user chooses to exit
-    printf("Thank you for using the IP Address Validator!\n");
+    // A bad length becomes an empty candidate over a zeroed buffer, so nothing
+    // outside the caller's bytes is read and the work below still runs in full
+    uint32_t bad = (uint32_t)(len - 7 > 8);  // Length outside 7-15
+    uint32_t n = bad ? 0 : (uint32_t)len;
+    const unsigned char* src = (const unsigned char*)(bad ? ipv4_zero16 : ip);
     
-    // Return 0 to indicate successful program completion
-    return 0;
-}
\ No newline at end of file
+    // A bad length loads the zeroed stand-in in full, which reads as all '\0'
+    uint64_t lo, hi;
+    ipv4_load_slice((const char*)src, bad ? sizeof(ipv4_zero16) - 1 : len, &lo, &hi);
+    unsigned char buf[24] = {0};
+    memcpy(buf, &lo, 8);
+    memcpy(buf + 8, &hi, 8);
+    
+    // Bit i of each mask describes position i of the candidate
+    uint32_t digits = ipv4_swar_gather(ipv4_swar_digits(lo)) | ipv4_swar_gather(ipv4_swar_digits(hi)) << 8;
+    uint32_t dots = ipv4_swar_gather(ipv4_swar_dots(lo)) | ipv4_swar_gather(ipv4_swar_dots(hi)) << 8;
+    bad |= (uint32_t)((digits | dots) != (1u << n) - 1);  // Not only digits and dots
+    bad |= (uint32_t)(ipv4_popcount(dots) != 3);          // Not exactly 3 dots
+    
+    // Sentinels above bit 15 keep the dot positions defined (and in the buffer)
+    // when there are fewer than 3 dots; that input is already marked bad
+    uint32_t m = dots | 0x70000;
+    uint32_t d1 = ipv4_ctz(m);
+    m &= m - 1;
+    uint32_t d2 = ipv4_ctz(m);
+    m &= m - 1;
+    uint32_t d3 = ipv4_ctz(m);
+    
+    uint32_t addr = ipv4_branchless_octet(buf, 0, d1, &bad) << 24;
+    addr |= ipv4_branchless_octet(buf, d1 + 1, d2 - d1 - 1, &bad) << 16;
+    addr |= ipv4_branchless_octet(buf, d2 + 1, d3 - d2 - 1, &bad) << 8;
+    addr |= ipv4_branchless_octet(buf, d3 + 1, n - d3 - 1, &bad);
+    
+    if (out != NULL) {
+        uint32_t keep = 0u - bad;
+        *out = (*out & keep) | (addr & ~keep);
+    }
+    return (int)(bad ^ 1);  // 1 if valid, 0 if invalid
+}
+
+/*
+ * SIMD engines
+ * 
+ * Every valid address is at most 15 bytes, so a whole candidate fits in one
+ * 128-bit register. The vector engines classify all bytes at once, pull the
+ * dot positions out of a movemask, and use the four octet lengths (each 1-3)
+ * to pick one of 81 shuffle patterns. The shuffle lines every octet up as
+ * [hundreds, tens, ones, 0] in its own 32-bit lane, and a pair of multiply-add
+ * instructions turns that into the octet values. No step branches on an
+ * individual character.
+ * 
+ * AVX2 is deliberately not used: one address never needs more than one
+ * 128-bit register, so the wider registers buy nothing here.
+ */
+#ifdef IPV4_HAVE_SSSE3
+#include <immintrin.h>
+#endif
+
+#ifdef IPV4_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(IPV4_HAVE_SSSE3) || defined(IPV4_HAVE_NEON)
+
+/*
+ * Shuffle patterns indexed by (len0-1)*27 + (len1-1)*9 + (len2-1)*3 + (len3-1).
+ * Lane i of the result holds octet i as [hundreds, tens, ones, pad]; 0x80
+ * selects zero, so short octets are padded on the left with zero digits.
+ */
+static const uint8_t ipv4_shuffle[81][16] = {
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80},  /* 1.1.1.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80},  /* 1.1.1.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80},  /* 1.1.1.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80},  /* 1.1.2.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80},  /* 1.1.2.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80},  /* 1.1.2.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 1.1.3.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 1.1.3.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 1.1.3.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80},  /* 1.2.1.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80},  /* 1.2.1.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80},  /* 1.2.1.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 1.2.2.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 1.2.2.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 1.2.2.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 1.2.3.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 1.2.3.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x80, 0x02, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 1.2.3.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 1.3.1.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 1.3.1.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 1.3.1.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 1.3.2.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 1.3.2.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 1.3.2.3 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 1.3.3.1 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 1.3.3.2 */
+    {0x80, 0x80, 0x00, 0x80, 0x02, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 1.3.3.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80},  /* 2.1.1.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80},  /* 2.1.1.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x80, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80},  /* 2.1.1.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 2.1.2.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 2.1.2.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x80, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 2.1.2.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 2.1.3.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 2.1.3.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x03, 0x80, 0x05, 0x06, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 2.1.3.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 2.2.1.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 2.2.1.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 2.2.1.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 2.2.2.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 2.2.2.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 2.2.2.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 2.2.3.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 2.2.3.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x80, 0x03, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 2.2.3.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 2.3.1.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 2.3.1.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 2.3.1.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 2.3.2.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 2.3.2.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 2.3.2.3 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x0B, 0x80},  /* 2.3.3.1 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x80, 0x0B, 0x0C, 0x80},  /* 2.3.3.2 */
+    {0x80, 0x00, 0x01, 0x80, 0x03, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x0B, 0x0C, 0x0D, 0x80},  /* 2.3.3.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80},  /* 3.1.1.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80},  /* 3.1.1.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x80, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80},  /* 3.1.1.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 3.1.2.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 3.1.2.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x80, 0x06, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 3.1.2.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 3.1.3.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 3.1.3.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x04, 0x80, 0x06, 0x07, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 3.1.3.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x80, 0x80, 0x09, 0x80},  /* 3.2.1.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x80, 0x09, 0x0A, 0x80},  /* 3.2.1.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x80, 0x07, 0x80, 0x09, 0x0A, 0x0B, 0x80},  /* 3.2.1.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 3.2.2.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 3.2.2.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x07, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 3.2.2.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x0B, 0x80},  /* 3.2.3.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x80, 0x0B, 0x0C, 0x80},  /* 3.2.3.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x80, 0x04, 0x05, 0x80, 0x07, 0x08, 0x09, 0x80, 0x0B, 0x0C, 0x0D, 0x80},  /* 3.2.3.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80, 0x80, 0x80, 0x0A, 0x80},  /* 3.3.1.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80, 0x80, 0x0A, 0x0B, 0x80},  /* 3.3.1.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x80, 0x08, 0x80, 0x0A, 0x0B, 0x0C, 0x80},  /* 3.3.1.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80, 0x80, 0x80, 0x0B, 0x80},  /* 3.3.2.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80, 0x80, 0x0B, 0x0C, 0x80},  /* 3.3.2.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x80, 0x08, 0x09, 0x80, 0x0B, 0x0C, 0x0D, 0x80},  /* 3.3.2.3 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80, 0x80, 0x80, 0x0C, 0x80},  /* 3.3.3.1 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80, 0x80, 0x0C, 0x0D, 0x80},  /* 3.3.3.2 */
+    {0x00, 0x01, 0x02, 0x80, 0x04, 0x05, 0x06, 0x80, 0x08, 0x09, 0x0A, 0x80, 0x0C, 0x0D, 0x0E, 0x80},  /* 3.3.3.3 */
+};
+
+/*
+ * Turns the dot mask of a candidate of length len into the shuffle pattern key.
+ * Returns -1 unless there are exactly 3 dots and every octet is 1-3 digits long.
+ */
+static inline int ipv4_octet_key(unsigned dots, unsigned len) {
+    if (__builtin_popcount(dots) != 3) {
+        return -1;  // Invalid: wrong number of dots
+    }
+    unsigned d1 = __builtin_ctz(dots);
+    dots &= dots - 1;
+    unsigned d2 = __builtin_ctz(dots);
+    dots &= dots - 1;
+    unsigned d3 = __builtin_ctz(dots);
+    
+    // Octet lengths minus one; unsigned wrap-around turns empty octets into huge values
+    unsigned l0 = d1 - 1;
+    unsigned l1 = d2 - d1 - 2;
+    unsigned l2 = d3 - d2 - 2;
+    unsigned l3 = len - d3 - 2;
+    if ((l0 > 2) | (l1 > 2) | (l2 > 2) | (l3 > 2)) {
+        return -1;  // Invalid: empty octet or more than 3 digits
+    }
+    return (int)(l0 * 27 + l1 * 9 + l2 * 3 + l3);
+}
+
+#endif /* IPV4_HAVE_SSSE3 || IPV4_HAVE_NEON */
+
+#ifdef IPV4_HAVE_SSSE3
+
+/**
+ * Function: parse_ipv4_ssse3
+ * Purpose: SSSE3 engine for parse_ipv4(), selected at runtime on x86
+ * 
+ * Requires SSSE3 (pshufb, pmaddubsw) and POPCNT, which every SSE4.2 capable CPU
+ * has. Same parameters, result and accept/reject behavior as parse_ipv4_scalar().
+ */
+__attribute__((target("ssse3,popcnt")))
+int parse_ipv4_ssse3(const char* ip, size_t len, uint32_t* out) {
+    if (ip == NULL || len < 7 || len > 15) {
+        return 0;  // Invalid: null pointer or length outside 7-15
+    }
+    
+    // Bring the candidate into a register without reading past its end
+    uint64_t lo, hi;
+    ipv4_load_slice(ip, len, &lo, &hi);
+    __m128i v = _mm_set_epi64x((long long)hi, (long long)lo);
+    
+    // Classify every byte: digits map to 0-9 after subtracting '0', dots are exact
+    unsigned live = (1u << len) - 1;  // Bytes that belong to the candidate
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t);
+    __m128i dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+    unsigned digits = (unsigned)_mm_movemask_epi8(digit) & live;
+    unsigned dots = (unsigned)_mm_movemask_epi8(dot) & live;
+    if ((digits | dots) != live) {
+        return 0;  // Invalid: contains non-digit, non-dot character
+    }
+    
+    // Dot positions give the octet lengths, which select the shuffle pattern
+    int key = ipv4_octet_key(dots, (unsigned)len);
+    if (key < 0) {
+        return 0;  // Invalid: wrong number of dots, empty or over-long octet
+    }
+    
+    // A leading zero is a '0' that starts an octet and is followed by a digit
+    unsigned starts = ((dots << 1) | 1u) & live;
+    unsigned zeros = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('0')));
+    if (starts & zeros & (digits >> 1)) {
+        return 0;  // Invalid: leading zeros not allowed
+    }
+    
+    // Line the digits up per octet and fold them: 100*h + 10*t + 1*o
+    __m128i lanes = _mm_shuffle_epi8(t, _mm_loadu_si128((const __m128i*)ipv4_shuffle[key]));
+    __m128i pairs = _mm_maddubs_epi16(lanes, _mm_setr_epi8(100, 10, 1, 0, 100, 10, 1, 0,
+                                                           100, 10, 1, 0, 100, 10, 1, 0));
+    __m128i values = _mm_madd_epi16(pairs, _mm_set1_epi16(1));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(values, _mm_set1_epi32(255)))) {
+        return 0;  // Invalid: octet value is outside the 0-255 range
+    }
+    
+    if (out != NULL) {
+        // Gather the low byte of each lane, first octet into the most significant byte
+        __m128i packed = _mm_shuffle_epi8(values, _mm_setr_epi8(12, 8, 4, 0, -1, -1, -1, -1,
+                                                                -1, -1, -1, -1, -1, -1, -1, -1));
+        *out = (uint32_t)_mm_cvtsi128_si32(packed);
+    }
+    return 1;  // Valid IPv4 address
+}
+
+#endif /* IPV4_HAVE_SSSE3 */
+
+#ifdef IPV4_HAVE_NEON
+
+/* Equivalent of _mm_movemask_epi8 for the 0x00/0xFF masks produced by NEON compares */
+static inline unsigned ipv4_neon_movemask(uint8x16_t m) {
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t x = vandq_u8(m, vld1q_u8(bits));
+    return (unsigned)vaddv_u8(vget_low_u8(x)) | ((unsigned)vaddv_u8(vget_high_u8(x)) << 8);
+}
+
+/**
+ * Function: parse_ipv4_neon
+ * Purpose: NEON engine for parse_ipv4() on AArch64, where NEON is always available
+ * 
+ * Same algorithm as parse_ipv4_ssse3(), using tbl for the shuffle and widening
+ * multiplies plus pairwise adds for the multiply-add.
+ */
+int parse_ipv4_neon(const char* ip, size_t len, uint32_t* out) {
+    if (ip == NULL || len < 7 || len > 15) {
+        return 0;  // Invalid: null pointer or length outside 7-15
+    }
+    
+    // Bring the candidate into a register without reading past its end
+    uint64_t lo, hi;
+    ipv4_load_slice(ip, len, &lo, &hi);
+    uint8x16_t v = vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(lo), vcreate_u64(hi)));
+    
+    // Classify every byte: digits map to 0-9 after subtracting '0', dots are exact
+    unsigned live = (1u << len) - 1;  // Bytes that belong to the candidate
+    uint8x16_t t = vsubq_u8(v, vdupq_n_u8('0'));
+    unsigned digits = ipv4_neon_movemask(vcleq_u8(t, vdupq_n_u8(9))) & live;
+    unsigned dots = ipv4_neon_movemask(vceqq_u8(v, vdupq_n_u8('.'))) & live;
+    if ((digits | dots) != live) {
+        return 0;  // Invalid: contains non-digit, non-dot character
+    }
+    
+    // Dot positions give the octet lengths, which select the shuffle pattern
+    int key = ipv4_octet_key(dots, (unsigned)len);
+    if (key < 0) {
+        return 0;  // Invalid: wrong number of dots, empty or over-long octet
+    }
+    
+    // A leading zero is a '0' that starts an octet and is followed by a digit
+    unsigned starts = ((dots << 1) | 1u) & live;
+    unsigned zeros = ipv4_neon_movemask(vceqq_u8(v, vdupq_n_u8('0')));
+    if (starts & zeros & (digits >> 1)) {
+        return 0;  // Invalid: leading zeros not allowed
+    }
+    
+    // Line the digits up per octet and fold them: 100*h + 10*t + 1*o
+    static const uint8_t weights[8] = {100, 10, 1, 0, 100, 10, 1, 0};
+    uint8x16_t lanes = vqtbl1q_u8(t, vld1q_u8(ipv4_shuffle[key]));
+    uint8x8_t w = vld1_u8(weights);
+    uint16x8_t lo = vmull_u8(vget_low_u8(lanes), w);
+    uint16x8_t hi = vmull_u8(vget_high_u8(lanes), w);
+    uint32x4_t values = vpaddlq_u16(vpaddq_u16(lo, hi));
+    if (vmaxvq_u32(values) > 255) {
+        return 0;  // Invalid: octet value is outside the 0-255 range
+    }
+    
+    if (out != NULL) {
+        // Gather the low byte of each lane, first octet into the most significant byte
+        static const uint8_t gather[16] = {12, 8, 4, 0, 255, 255, 255, 255,
+                                           255, 255, 255, 255, 255, 255, 255, 255};
+        uint8x16_t packed = vqtbl1q_u8(vreinterpretq_u8_u32(values), vld1q_u8(gather));
+        *out = vgetq_lane_u32(vreinterpretq_u32_u8(packed), 0);
+    }
+    return 1;  // Valid IPv4 address
+}
+
+#endif /* IPV4_HAVE_NEON */
+
+// Marks rarely taken paths, which are kept out of line
+#if defined(__GNUC__)
+#define IPV4_COLD __attribute__((cold, noinline))
+#else
+#define IPV4_COLD
+#endif
+
+/*
+ * Optional instrumentation
+ * 
+ * Building with -DVALIDATE_IP_STATS counts every parse_ipv4() and
+ * validate_ip_batch() call (calls, accepts, bytes scanned and rejects by
+ * reason) and times one call in IPV4_STATS_SAMPLE_EVERY with the CPU tick
+ * counter into a log2-bucketed histogram. ipv4_stats_snapshot() merges the
+ * numbers of all threads. Without the flag none of this is compiled and
+ * parse_ipv4() is exactly the dispatch below.
+ * 
+ * Each thread owns a block of counters, so counting needs no lock and no
+ * atomic read-modify-write: the owner does a relaxed load and store, and a
+ * snapshot only ever reads. Blocks are pushed onto a lock-free list on a
+ * thread's first call and never freed, so the counts of threads that have
+ * exited stay in the totals.
+ * 
+ * A valid candidate costs a few extra loads and stores. A rejected one is
+ * re-scanned by the cold ipv4_diagnose() to count its reason, which roughly
+ * doubles the cost of a reject.
+ */
+
+#ifdef VALIDATE_IP_STATS
+#include <stdatomic.h>
+#include <time.h>
+
+// Every how many calls of a thread one is timed, must be a power of two
+#ifndef IPV4_STATS_SAMPLE_EVERY
+#define IPV4_STATS_SAMPLE_EVERY 64
+#endif
+
+#if (IPV4_STATS_SAMPLE_EVERY & (IPV4_STATS_SAMPLE_EVERY - 1)) != 0
+#error "IPV4_STATS_SAMPLE_EVERY must be a power of two"
+#endif
+
+struct ipv4_stats_block {
+    _Atomic uint64_t calls;
+    _Atomic uint64_t accepts;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t samples;
+    _Atomic uint64_t rejects[IPV4_STATS_REASONS];
+    _Atomic uint64_t latency[IPV4_STATS_BUCKETS];
+    struct ipv4_stats_block* next;  // Next registered block, set before publishing
+};
+
+static _Atomic(struct ipv4_stats_block*) ipv4_stats_head;
+static _Thread_local struct ipv4_stats_block* ipv4_stats_local;
+
+// Shared by threads whose own block could not be allocated; counts may be lost there
+static struct ipv4_stats_block ipv4_stats_fallback;
+
+/*
+ * Tick counter for the latency samples: the TSC on x86, the generic timer on
+ * AArch64, and nanoseconds of a monotonic-enough clock elsewhere
+ */
+static inline uint64_t ipv4_stats_ticks(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Owner-only increment: one plain add, but still a data-race-free access for readers
+static inline void ipv4_stats_add(_Atomic uint64_t* counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+// Allocates and publishes the calling thread's block, once per thread
+IPV4_COLD static struct ipv4_stats_block* ipv4_stats_register(void) {
+    struct ipv4_stats_block* block = calloc(1, sizeof(*block));
+    if (block == NULL) {
+        block = &ipv4_stats_fallback;
+    } else {
+        block->next = atomic_load_explicit(&ipv4_stats_head, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&ipv4_stats_head, &block->next, block,
+                                                      memory_order_release,
+                                                      memory_order_relaxed)) {
+        }
+    }
+    ipv4_stats_local = block;
+    return block;
+}
+
+static inline struct ipv4_stats_block* ipv4_stats_block(void) {
+    struct ipv4_stats_block* block = ipv4_stats_local;
+    return block != NULL ? block : ipv4_stats_register();
+}
+
+// Works out and counts the reason for a rejected candidate, see further down
+static void ipv4_stats_reject(struct ipv4_stats_block* block, const char* ip, size_t len);
+
+// Counts one parsed candidate
+static inline void ipv4_stats_count(struct ipv4_stats_block* block, const char* ip,
+                                    size_t len, int ok) {
+    ipv4_stats_add(&block->calls, 1);
+    ipv4_stats_add(&block->bytes, len);
+    if (ok) {
+        ipv4_stats_add(&block->accepts, 1);
+    } else {
+        ipv4_stats_reject(block, ip, len);
+    }
+}
+
+// Adds one latency sample to the histogram
+static inline void ipv4_stats_sample(struct ipv4_stats_block* block, uint64_t ticks) {
+    unsigned bucket = ticks == 0 ? 0 : 63 - (unsigned)__builtin_clzll(ticks);
+    if (bucket >= IPV4_STATS_BUCKETS) {
+        bucket = IPV4_STATS_BUCKETS - 1;
+    }
+    ipv4_stats_add(&block->samples, 1);
+    ipv4_stats_add(&block->latency[bucket], 1);
+}
+#endif /* VALIDATE_IP_STATS */
+
+// Engine selection behind parse_ipv4()
+static inline int ipv4_parse_dispatch(const char* ip, size_t len, uint32_t* out) {
+#if defined(IPV4_HAVE_NEON)
+    return parse_ipv4_neon(ip, len, out);
+#else
+#if defined(IPV4_HAVE_SSSE3)
+    if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt")) {
+        return parse_ipv4_ssse3(ip, len, out);
+    }
+#endif
+    return parse_ipv4_table(ip, len, out);
+#endif
+}
+
+/**
+ * Function: parse_ipv4
+ * Purpose: Validates and decodes an IPv4 address using the fastest engine available
+ * 
+ * On AArch64 this is always the NEON engine. On x86 the SSSE3 engine is used
+ * when the running CPU supports it, otherwise (and on every other platform)
+ * the table-driven parse_ipv4_table(). The CPU check only reads flags that libgcc fills in
+ * before main(), so there is no lazily initialized state to race on.
+ * 
+ * Thread safety: like every parser in this file it is fully reentrant. No
+ * engine keeps static or global state (the only statics are read-only
+ * tables), so any number of threads may call it concurrently without locking.
+ * With VALIDATE_IP_STATS each thread only writes its own counters.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid (first octet in the most
+ *                  significant byte), may be NULL. Left untouched when invalid.
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+int parse_ipv4(const char* ip, size_t len, uint32_t* out) {
+#ifdef VALIDATE_IP_STATS
+    struct ipv4_stats_block* stats = ipv4_stats_block();
+    int sampled = (atomic_load_explicit(&stats->calls, memory_order_relaxed) &
+                   (IPV4_STATS_SAMPLE_EVERY - 1)) == 0;
+    uint64_t start = sampled ? ipv4_stats_ticks() : 0;
+    int ok = ipv4_parse_dispatch(ip, len, out);
+    if (sampled) {
+        ipv4_stats_sample(stats, ipv4_stats_ticks() - start);
+    }
+    ipv4_stats_count(stats, ip, len, ok);
+    return ok;
+#else
+    return ipv4_parse_dispatch(ip, len, out);
+#endif
+}
+
+/*
+ * Length of a null-terminated candidate, but never looking further than one byte
+ * past the longest valid address: anything longer is rejected by the parser anyway.
+ */
+static inline size_t ipv4_bounded_len(const char* ip) {
+    size_t len = 0;
+    while (len < 16 && ip[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * Function: validate_ip
+ * Purpose: Validates whether a given string represents a valid IPv4 address
+ * 
+ * IPv4 Address Format Requirements:
+ * - Must contain exactly 4 octets (numbers) separated by 3 dots
+ * - Each octet must be a number between 0 and 255 (inclusive)
+ * - No leading zeros allowed (except for the number "0" itself)
+ * - Only digits and dots are permitted characters
+ * - Total length must be between 7 and 15 characters
+ * 
+ * Parameter: ip - pointer to null-terminated string containing the IP address to validate
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+int validate_ip(const char* ip) {
+    // First safety check: ensure the input pointer is not NULL
+    // This prevents segmentation faults when accessing the string
+    if (ip == NULL) {
+        return 0;  // Invalid: null pointer means no string to validate
+    }
+    
+    return parse_ipv4(ip, ipv4_bounded_len(ip), NULL);
+}
+
+/**
+ * Function: validate_ip_n
+ * Purpose: Validates an IPv4 address held in a length-delimited slice
+ * 
+ * Same rules as validate_ip(), but the candidate is the n bytes starting at p
+ * rather than a null-terminated string. Nothing is copied and no byte at or
+ * after p[n] is ever read, so slices can be validated in place straight out of
+ * larger network or log buffers (including read-only mmap'd files).
+ * A '\0' inside the slice is treated like any other invalid character.
+ * 
+ * Parameter: p - pointer to the first character of the candidate address
+ * Parameter: n - number of characters in the candidate address
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+int validate_ip_n(const char* p, size_t n) {
+    return parse_ipv4(p, n, NULL);
+}
+
+/*
+ * How many entries ahead validate_ip_batch() prefetches. Far enough to cover a
+ * cache miss on a string, near enough that the line is still resident when the
+ * parser gets to it.
+ */
+#define IPV4_PREFETCH_DISTANCE 8
+
+#if defined(__GNUC__)
+#define IPV4_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define IPV4_PREFETCH(p) ((void)0)
+#endif
+
+/*
+ * Body shared by the per-engine batch loops. Entries are handled in groups of 8
+ * so each group produces exactly one bitmap byte; validity is folded in with
+ * shifts and ors rather than branches, and addrs is written unconditionally.
+ * With a classes column the address is classified right after the parse,
+ * while it is still in a register.
+ */
+#define IPV4_BATCH_LOOP(engine)                                                   \
+    size_t valid = 0;                                                             \
+    for (size_t base = 0; base < n; base += 8) {                                  \
+        size_t group = n - base < 8 ? n - base : 8;                               \
+        unsigned bits = 0;                                                        \
+        for (size_t j = 0; j < group; j++) {                                      \
+            size_t i = base + j;                                                  \
+            if (i + IPV4_PREFETCH_DISTANCE < n) {                                 \
+                IPV4_PREFETCH(ips[i + IPV4_PREFETCH_DISTANCE]);                   \
+            }                                                                     \
+            const char* p = ips[i];                                               \
+            size_t len = lens != NULL ? lens[i] : (p != NULL ? ipv4_bounded_len(p) : 0); \
+            uint32_t addr = 0;                                                    \
+            unsigned ok = (unsigned)engine(p, len, &addr);                        \
+            bits |= ok << j;                                                      \
+            valid += ok;                                                          \
+            if (addrs != NULL) {                                                  \
+                addrs[i] = addr;                                                  \
+            }                                                                     \
+            if (classes != NULL) {                                                \
+                classes[i] = (uint8_t)(ipv4_classify(addr) & (0u - ok));          \
+            }                                                                     \
+        }                                                                         \
+        valid_bitmap[base / 8] = (uint8_t)bits;                                   \
+    }                                                                             \
+    return valid;
+
+static size_t ipv4_batch_table(const char* const* ips, const size_t* lens, size_t n,
+                               uint8_t* valid_bitmap, uint32_t* addrs, uint8_t* classes) {
+    IPV4_BATCH_LOOP(parse_ipv4_table)
+}
+
+#ifdef IPV4_HAVE_SSSE3
+__attribute__((target("ssse3,popcnt")))
+static size_t ipv4_batch_ssse3(const char* const* ips, const size_t* lens, size_t n,
+                               uint8_t* valid_bitmap, uint32_t* addrs, uint8_t* classes) {
+    IPV4_BATCH_LOOP(parse_ipv4_ssse3)
+}
+#endif
+
+#ifdef IPV4_HAVE_NEON
+static size_t ipv4_batch_neon(const char* const* ips, const size_t* lens, size_t n,
+                              uint8_t* valid_bitmap, uint32_t* addrs, uint8_t* classes) {
+    IPV4_BATCH_LOOP(parse_ipv4_neon)
+}
+#endif
+
+/**
+ * Function: validate_ip_batch
+ * Purpose: Validates and decodes many IPv4 addresses in one call
+ * 
+ * The engine is chosen once for the whole batch instead of once per address, and
+ * the loop for each engine is compiled with that engine inlined, so independent
+ * parses can overlap and upcoming strings are prefetched while earlier ones are
+ * still being checked.
+ * 
+ * Parameter: ips          - array of n pointers to candidate addresses (NULL entries are invalid)
+ * Parameter: lens         - array of n lengths, or NULL if every entry of ips is null-terminated
+ * Parameter: n            - number of candidates
+ * Parameter: valid_bitmap - receives (n + 7) / 8 bytes; bit (i % 8) of byte (i / 8) is set
+ *                           when ips[i] is valid, unused bits of the last byte are cleared
+ * Parameter: addrs        - receives n packed addresses (0 for invalid entries), may be NULL
+ * Returns: number of valid addresses in the batch
+ */
+size_t validate_ip_batch(const char* const* ips, const size_t* lens, size_t n,
+                         uint8_t* valid_bitmap, uint32_t* addrs) {
+    return validate_ip_batch_classify(ips, lens, n, valid_bitmap, addrs, NULL);
+}
+
+/**
+ * Function: validate_ip_batch_classify
+ * Purpose: validate_ip_batch() that also classifies every valid address
+ * 
+ * Classification is fused into the batch loop rather than run as a second
+ * pass, so it costs a few compares per address and no reparse.
+ * 
+ * Parameter: ips          - as for validate_ip_batch()
+ * Parameter: lens         - as for validate_ip_batch()
+ * Parameter: n            - number of candidates
+ * Parameter: valid_bitmap - as for validate_ip_batch()
+ * Parameter: addrs        - as for validate_ip_batch(), may be NULL
+ * Parameter: classes      - receives n bytes of ipv4_classify() flags (0 for invalid entries), may be NULL
+ * Returns: number of valid addresses in the batch
+ */
+size_t validate_ip_batch_classify(const char* const* ips, const size_t* lens, size_t n,
+                                  uint8_t* valid_bitmap, uint32_t* addrs, uint8_t* classes) {
+    size_t valid;
+#if defined(IPV4_HAVE_NEON)
+    valid = ipv4_batch_neon(ips, lens, n, valid_bitmap, addrs, classes);
+#else
+#if defined(IPV4_HAVE_SSSE3)
+    if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt")) {
+        valid = ipv4_batch_ssse3(ips, lens, n, valid_bitmap, addrs, classes);
+    } else
+#endif
+    valid = ipv4_batch_table(ips, lens, n, valid_bitmap, addrs, classes);
+#endif
+    
+#ifdef VALIDATE_IP_STATS
+    // Counted after the fact from the bitmap, so the batch loops stay untouched
+    struct ipv4_stats_block* stats = ipv4_stats_block();
+    for (size_t i = 0; i < n; i++) {
+        const char* p = ips[i];
+        size_t len = lens != NULL ? lens[i] : (p != NULL ? ipv4_bounded_len(p) : 0);
+        ipv4_stats_count(stats, p, len, (valid_bitmap[i / 8] >> (i % 8)) & 1);
+    }
+#endif
+    return valid;
+}
+
+/**
+ * Function: parse_ipv4_classify
+ * Purpose: parse_ipv4() that also says which special-purpose ranges the address is in
+ * 
+ * Parameter: ip    - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len   - number of characters at ip that make up the candidate address
+ * Parameter: out   - receives the packed address when valid, may be NULL
+ * Parameter: flags - receives the IPV4_CLASS_* flags of the address, 0 when invalid; may be NULL
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+int parse_ipv4_classify(const char* ip, size_t len, uint32_t* out, unsigned* flags) {
+    uint32_t addr = 0;
+#ifdef VALIDATE_IP_STATS
+    int ok = parse_ipv4(ip, len, &addr);  // Counted like any other parse_ipv4() call
+#else
+    int ok = ipv4_parse_dispatch(ip, len, &addr);
+#endif
+    if (ok && out != NULL) {
+        *out = addr;
+    }
+    if (flags != NULL) {
+        *flags = ok ? ipv4_classify(addr) : 0;
+    }
+    return ok;
+}
+
+/*
+ * IPv6
+ * 
+ * Text forms as in RFC 4291 section 2.2: eight groups of 1-4 hex digits, at
+ * most one "::" standing for one or more zero groups, and optionally a
+ * trailing dotted-quad (as in "::ffff:192.0.2.1") in place of the last two
+ * groups. The dotted-quad part follows exactly the same rules as
+ * validate_ip(). Zone identifiers ("%eth0") are not addresses and are rejected.
+ */
+
+// Value of a hex digit, or -1
+static inline int ipv6_hex(unsigned char c) {
+    if ((unsigned)(c - '0') < 10) {
+        return c - '0';
+    }
+    c |= 0x20;  // Fold 'A'-'F' onto 'a'-'f'
+    return (unsigned)(c - 'a') < 6 ? c - 'a' + 10 : -1;
+}
+
+/**
+ * Function: parse_ipv6
+ * Purpose: Validates and decodes an IPv6 address in a single left-to-right scan
+ * 
+ * Like parse_ipv4() it works on a slice in place and keeps no state.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the 16 address bytes in network order when valid, may be
+ *                  NULL. Left untouched when invalid.
+ * Returns: 1 if valid IPv6 address, 0 if invalid
+ */
+int parse_ipv6(const char* ip, size_t len, uint8_t out[16]) {
+    // Shortest is "::", longest is e.g. "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255"
+    if (ip == NULL || len < 2 || len > 45) {
+        return 0;  // Invalid: null pointer or length outside 2-45
+    }
+    
+    uint16_t words[8];   // Groups read so far
+    size_t count = 0;    // Number of groups read
+    size_t gap = 9;      // Group index where "::" appeared, 9 if it did not
+    size_t i = 0;
+    
+    // A leading colon is only allowed as part of "::"
+    if (ip[0] == ':') {
+        if (ip[1] != ':') {
+            return 0;  // Invalid: single leading colon
+        }
+        gap = 0;
+        i = 2;
+    }
+    
+    while (i < len) {
+        // One group of hex digits
+        size_t start = i;
+        unsigned value = 0;
+        int hex;
+        while (i < len && i - start < 5 && (hex = ipv6_hex((unsigned char)ip[i])) >= 0) {
+            value = value * 16 + (unsigned)hex;
+            i++;
+        }
+        
+        // A dot means this "group" is the first octet of a trailing dotted-quad
+        if (i < len && ip[i] == '.') {
+            uint32_t v4;
+            if (count > 6 || !parse_ipv4(ip + start, len - start, &v4)) {
+                return 0;  // Invalid: no room for two more groups, or a bad dotted-quad
+            }
+            words[count++] = (uint16_t)(v4 >> 16);
+            words[count++] = (uint16_t)v4;
+            i = len;
+            break;
+        }
+        
+        if (i == start || i - start > 4) {
+            return 0;  // Invalid: empty group or more than 4 hex digits
+        }
+        if (count == 8) {
+            return 0;  // Invalid: more than 8 groups
+        }
+        words[count++] = (uint16_t)value;
+        if (i == len) {
+            break;
+        }
+        
+        // Groups are separated by ':', and "::" may appear once
+        if (ip[i] != ':') {
+            return 0;  // Invalid: character that is not a hex digit, ':' or '.'
+        }
+        i++;
+        if (i < len && ip[i] == ':') {
+            if (gap != 9) {
+                return 0;  // Invalid: more than one "::"
+            }
+            gap = count;
+            i++;
+        } else if (i == len) {
+            return 0;  // Invalid: single trailing colon
+        }
+    }
+    
+    // Without "::" all 8 groups must be present; with it, it must stand for at least one
+    if (gap == 9 ? count != 8 : count > 7) {
+        return 0;  // Invalid: wrong number of groups
+    }
+    
+    if (out != NULL) {
+        // Groups before the gap, zeros for the gap, then the groups after it
+        size_t tail = gap == 9 ? 0 : count - gap;
+        size_t head = count - tail;
+        memset(out, 0, 16);
+        for (size_t k = 0; k < head; k++) {
+            out[2 * k] = (uint8_t)(words[k] >> 8);
+            out[2 * k + 1] = (uint8_t)words[k];
+        }
+        for (size_t k = 0; k < tail; k++) {
+            size_t to = 8 - tail + k;
+            out[2 * to] = (uint8_t)(words[head + k] >> 8);
+            out[2 * to + 1] = (uint8_t)words[head + k];
+        }
+    }
+    return 1;  // Valid IPv6 address
+}
+
+/**
+ * Function: parse_ip
+ * Purpose: Validates and decodes an IPv4 or IPv6 address
+ * 
+ * Picks the family from the first bytes: an IPv6 address always has a ':'
+ * within its first 5 characters and a valid IPv4 address never does. IPv4
+ * input goes through the fast parse_ipv4() path and is also returned in
+ * IPv4-mapped form, so callers can treat every result as 128 bits.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the address when valid, may be NULL. Left untouched when invalid.
+ * Returns: 4 for a valid IPv4 address, 6 for a valid IPv6 address, 0 if invalid
+ */
+int parse_ip(const char* ip, size_t len, struct ip_addr* out) {
+    if (ip == NULL) {
+        return 0;  // Invalid: null pointer means no string to validate
+    }
+    if (memchr(ip, ':', len < 5 ? len : 5) != NULL) {
+        uint8_t bytes[16];
+        if (!parse_ipv6(ip, len, bytes)) {
+            return 0;
+        }
+        if (out != NULL) {
+            out->family = 6;
+            out->v4 = 0;
+            memcpy(out->bytes, bytes, 16);
+        }
+        return 6;
+    }
+    
+    uint32_t v4;
+    if (!parse_ipv4(ip, len, &v4)) {
+        return 0;
+    }
+    if (out != NULL) {
+        static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+        out->family = 4;
+        out->v4 = v4;
+        memcpy(out->bytes, mapped, 12);
+        out->bytes[12] = (uint8_t)(v4 >> 24);
+        out->bytes[13] = (uint8_t)(v4 >> 16);
+        out->bytes[14] = (uint8_t)(v4 >> 8);
+        out->bytes[15] = (uint8_t)v4;
+    }
+    return 4;
+}
+
+/**
+ * Function: parse_ip_batch
+ * Purpose: parse_ip() over many candidates, mirroring validate_ip_batch()
+ * 
+ * Parameter: ips          - array of n pointers to candidate addresses (NULL entries are invalid)
+ * Parameter: lens         - array of n lengths, or NULL if every entry of ips is null-terminated
+ * Parameter: n            - number of candidates
+ * Parameter: valid_bitmap - receives (n + 7) / 8 bytes; bit (i % 8) of byte (i / 8) is set
+ *                           when ips[i] is valid, unused bits of the last byte are cleared
+ * Parameter: addrs        - receives n addresses (family 0 and all zero for invalid
+ *                           entries), may be NULL
+ * Returns: number of valid addresses in the batch
+ */
+size_t parse_ip_batch(const char* const* ips, const size_t* lens, size_t n,
+                      uint8_t* valid_bitmap, struct ip_addr* addrs) {
+    size_t valid = 0;
+    for (size_t base = 0; base < n; base += 8) {
+        size_t group = n - base < 8 ? n - base : 8;
+        unsigned bits = 0;
+        for (size_t j = 0; j < group; j++) {
+            size_t i = base + j;
+            if (i + IPV4_PREFETCH_DISTANCE < n) {
+                IPV4_PREFETCH(ips[i + IPV4_PREFETCH_DISTANCE]);
+            }
+            const char* p = ips[i];
+            // IPv6 text can be up to 45 bytes, so the bounded length helper does not apply
+            size_t len = lens != NULL ? lens[i] : (p != NULL ? strlen(p) : 0);
+            struct ip_addr addr = {0, 0, {0}};
+            unsigned ok = parse_ip(p, len, &addr) != 0;
+            bits |= ok << j;
+            valid += ok;
+            if (addrs != NULL) {
+                addrs[i] = addr;
+            }
+        }
+        valid_bitmap[base / 8] = (uint8_t)bits;
+    }
+    return valid;
+}
+
+/*
+ * Line-delimited batches
+ * 
+ * The bulk-processing shape of the batch API: one buffer of text with one
+ * candidate per line, as read straight from a file. A line is everything up
+ * to the next '\n', exactly as in the stream modes of the CLI, and a last
+ * line without a '\n' still counts.
+ */
+
+/**
+ * Function: validate_ip_lines
+ * Purpose: Validates and decodes every line of a text buffer
+ * 
+ * Lines are found with memchr(), and each one is checked by parse_ipv4().
+ * Processing stops after *lines lines, so a large buffer can be worked
+ * through with fixed-size output arrays by calling again from the returned
+ * offset.
+ * 
+ * Parameter: buf          - text, one candidate per line (need not be null-terminated)
+ * Parameter: n            - number of bytes in buf
+ * Parameter: lines        - in: capacity of the outputs in lines; out: lines processed
+ * Parameter: valid_bitmap - receives (lines + 7) / 8 bytes; bit (i % 8) of byte (i / 8) is set
+ *                           when line i is valid, unused bits of the last byte are cleared
+ * Parameter: addrs        - receives one packed address per line (0 for invalid lines), may be NULL
+ * Returns: number of bytes of buf consumed (always whole lines)
+ */
+size_t validate_ip_lines(const char* buf, size_t n, size_t* lines,
+                         uint8_t* valid_bitmap, uint32_t* addrs) {
+    size_t cap = *lines, count = 0, pos = 0;
+    unsigned bits = 0;
+    
+    while (pos < n && count < cap) {
+        const char* nl = memchr(buf + pos, '\n', n - pos);
+        size_t len = nl != NULL ? (size_t)(nl - (buf + pos)) : n - pos;
+        uint32_t addr = 0;
+        bits |= (unsigned)parse_ipv4(buf + pos, len, &addr) << (count % 8);
+        if (addrs != NULL) {
+            addrs[count] = addr;
+        }
+        pos += len + (nl != NULL);
+        if (++count % 8 == 0) {
+            valid_bitmap[count / 8 - 1] = (uint8_t)bits;
+            bits = 0;
+        }
+    }
+    if (count % 8 != 0) {
+        valid_bitmap[count / 8] = (uint8_t)bits;
+    }
+    *lines = count;
+    return pos;
+}
+
+/*
+ * GPU backend (OpenCL, built with -DVALIDATE_IP_OPENCL)
+ * 
+ * For offline reprocessing of very large archives. The host indexes the line
+ * starts of a chunk with memchr() and the device validates the chunk with
+ * one work-item per line, running the same algorithm as parse_ipv4_scalar().
+ * Two chunks are in flight on two command queues: while the device copies
+ * and checks one, the host indexes the next, and each queue's copies in both
+ * directions overlap with the other queue's kernel.
+ * 
+ * Parsing one address is a handful of instructions, so the device only pays
+ * off once the transfer is amortized over a lot of lines. Batches smaller
+ * than IPV4_GPU_MIN_BYTES, a NULL context (no device, or a build without
+ * OpenCL) and any OpenCL error all fall back to validate_ip_lines(), so the
+ * result is the same in every case.
+ */
+#ifdef VALIDATE_IP_OPENCL
+
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#define IPV4_GPU_CHUNK_LINES (1 << 20)  // Lines per chunk, at most
+#define IPV4_GPU_CHUNK_BYTES (32 << 20) // Text bytes per chunk, at most
+#define IPV4_GPU_SLOTS 2                // Chunks in flight
+
+static const char ipv4_gpu_source[] =
+    "__kernel void ipv4_lines(__global const uchar* data, __global const uint* starts,\n"
+    "                         uint lines, __global uint* addrs, __global uchar* valid) {\n"
+    "    uint i = get_global_id(0);\n"
+    "    if (i >= lines) {\n"
+    "        return;\n"
+    "    }\n"
+    "    uint p = starts[i];\n"
+    "    uint len = starts[i + 1] - p - 1;\n"
+    "    uint addr = 0, octet = 0, digits = 0, dots = 0;\n"
+    "    int ok = len >= 7 && len <= 15;\n"
+    "    for (uint k = 0; ok && k < len; k++) {\n"
+    "        uchar c = data[p + k];\n"
+    "        if (c == '.') {\n"
+    "            ok = digits != 0 && ++dots <= 3;\n"
+    "            addr = (addr << 8) | octet;\n"
+    "            octet = 0;\n"
+    "            digits = 0;\n"
+    "        } else {\n"
+    "            uint d = (uint)c - '0';\n"
+    "            ok = d <= 9 && !(digits == 1 && octet == 0);\n"
+    "            octet = octet * 10 + d;\n"
+    "            ok = ok && octet <= 255;\n"
+    "            digits++;\n"
+    "        }\n"
+    "    }\n"
+    "    ok = ok && dots == 3 && digits != 0;\n"
+    "    addrs[i] = ok ? (addr << 8) | octet : 0;\n"
+    "    valid[i] = (uchar)ok;\n"
+    "}\n";
+
+struct ipv4_gpu_slot {
+    cl_command_queue queue;
+    cl_mem data;            // Text of the chunk
+    cl_mem starts;          // Offset of every line start, plus one past the end
+    cl_mem addrs;           // One packed address per line
+    cl_mem valid;           // One 0/1 byte per line
+    uint32_t* host_starts;  // Filled by the host, read by the device
+    uint8_t* host_valid;    // Filled by the device, packed into the caller's bitmap
+    cl_event done;          // Last command of the chunk in flight
+    size_t first_line;      // Index of the chunk's first line in the batch
+    size_t lines;           // Lines in the chunk, 0 when the slot is idle
+};
+
+struct ipv4_gpu {
+    cl_context context;
+    cl_program program;
+    cl_kernel kernel;
+    struct ipv4_gpu_slot slots[IPV4_GPU_SLOTS];
+};
+
+#endif /* VALIDATE_IP_OPENCL */
+
+// Batches below this many bytes always stay on the CPU
+#ifndef IPV4_GPU_MIN_BYTES
+#define IPV4_GPU_MIN_BYTES (16 << 20)
+#endif
+
+/**
+ * Function: ipv4_gpu_free
+ * Purpose: Releases a context from ipv4_gpu_create(); NULL is ignored
+ */
+void ipv4_gpu_free(struct ipv4_gpu* gpu) {
+    if (gpu == NULL) {
+        return;
+    }
+#ifdef VALIDATE_IP_OPENCL
+    for (int s = 0; s < IPV4_GPU_SLOTS; s++) {
+        struct ipv4_gpu_slot* slot = &gpu->slots[s];
+        if (slot->done != NULL) {
+            clReleaseEvent(slot->done);
+        }
+        cl_mem bufs[] = { slot->data, slot->starts, slot->addrs, slot->valid };
+        for (size_t b = 0; b < sizeof(bufs) / sizeof(bufs[0]); b++) {
+            if (bufs[b] != NULL) {
+                clReleaseMemObject(bufs[b]);
+            }
+        }
+        if (slot->queue != NULL) {
+            clReleaseCommandQueue(slot->queue);
+        }
+        free(slot->host_starts);
+        free(slot->host_valid);
+    }
+    if (gpu->kernel != NULL) {
+        clReleaseKernel(gpu->kernel);
+    }
+    if (gpu->program != NULL) {
+        clReleaseProgram(gpu->program);
+    }
+    if (gpu->context != NULL) {
+        clReleaseContext(gpu->context);
+    }
+#endif
+    free(gpu);
+}
+
+/**
+ * Function: ipv4_gpu_create
+ * Purpose: Sets up the GPU backend on the first GPU of the first platform that has one
+ * 
+ * Compiles the kernel and allocates the device buffers for both chunks in
+ * flight, about 2 x 41 MiB of device memory. One context may be used by one
+ * thread at a time.
+ * 
+ * Returns: the new context, or NULL without a usable device or in a build
+ *          without VALIDATE_IP_OPENCL (ipv4_gpu_validate_lines() then uses the CPU)
+ */
+struct ipv4_gpu* ipv4_gpu_create(void) {
+#ifdef VALIDATE_IP_OPENCL
+    cl_platform_id platforms[8];
+    cl_uint platform_count = 0;
+    if (clGetPlatformIDs(8, platforms, &platform_count) != CL_SUCCESS) {
+        return NULL;  // No OpenCL implementation installed
+    }
+    cl_device_id device = NULL;
+    for (cl_uint p = 0; p < platform_count && device == NULL; p++) {
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_GPU, 1, &device, NULL) != CL_SUCCESS) {
+            device = NULL;
+        }
+    }
+    if (device == NULL) {
+        return NULL;  // No GPU on any platform
+    }
+    
+    struct ipv4_gpu* gpu = calloc(1, sizeof(*gpu));
+    if (gpu == NULL) {
+        return NULL;
+    }
+    cl_int err;
+    const char* source = ipv4_gpu_source;
+    gpu->context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+    if (err == CL_SUCCESS) {
+        gpu->program = clCreateProgramWithSource(gpu->context, 1, &source, NULL, &err);
+    }
+    if (err == CL_SUCCESS) {
+        err = clBuildProgram(gpu->program, 1, &device, NULL, NULL, NULL);
+    }
+    if (err == CL_SUCCESS) {
+        gpu->kernel = clCreateKernel(gpu->program, "ipv4_lines", &err);
+    }
+    for (int s = 0; s < IPV4_GPU_SLOTS && err == CL_SUCCESS; s++) {
+        struct ipv4_gpu_slot* slot = &gpu->slots[s];
+        slot->queue = clCreateCommandQueue(gpu->context, device, 0, &err);
+        if (err == CL_SUCCESS) {
+            slot->data = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY, IPV4_GPU_CHUNK_BYTES, NULL, &err);
+        }
+        if (err == CL_SUCCESS) {
+            slot->starts = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY,
+                                          (IPV4_GPU_CHUNK_LINES + 1) * sizeof(uint32_t), NULL, &err);
+        }
+        if (err == CL_SUCCESS) {
+            slot->addrs = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY,
+                                         IPV4_GPU_CHUNK_LINES * sizeof(uint32_t), NULL, &err);
+        }
+        if (err == CL_SUCCESS) {
+            slot->valid = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY, IPV4_GPU_CHUNK_LINES, NULL, &err);
+        }
+        slot->host_starts = malloc((IPV4_GPU_CHUNK_LINES + 1) * sizeof(uint32_t));
+        slot->host_valid = malloc(IPV4_GPU_CHUNK_LINES);
+        if (slot->host_starts == NULL || slot->host_valid == NULL) {
+            err = CL_OUT_OF_HOST_MEMORY;
+        }
+    }
+    if (err != CL_SUCCESS) {
+        ipv4_gpu_free(gpu);
+        return NULL;
+    }
+    return gpu;
+#else
+    return NULL;
+#endif
+}
+
+#ifdef VALIDATE_IP_OPENCL
+// Waits for the chunk in slot and ORs its results into the caller's bitmap
+static cl_int ipv4_gpu_finish(struct ipv4_gpu_slot* slot, uint8_t* valid_bitmap) {
+    if (slot->lines == 0) {
+        return CL_SUCCESS;
+    }
+    cl_int err = clWaitForEvents(1, &slot->done);
+    clReleaseEvent(slot->done);
+    slot->done = NULL;
+    if (err == CL_SUCCESS) {
+        // Chunks need not start on a byte boundary of the bitmap, hence bit by bit
+        for (size_t i = 0; i < slot->lines; i++) {
+            size_t line = slot->first_line + i;
+            valid_bitmap[line / 8] |= (uint8_t)((slot->host_valid[i] & 1u) << (line % 8));
+        }
+    }
+    slot->lines = 0;
+    return err;
+}
+#endif
+
+/**
+ * Function: ipv4_gpu_validate_lines
+ * Purpose: validate_ip_lines() on the GPU, for batches large enough to be worth it
+ * 
+ * Same parameters and results as validate_ip_lines(), which it falls back to
+ * for small batches, a NULL gpu and any device error. The caller's buffers
+ * must not be touched until it returns. A single line too long to fit in a
+ * chunk cannot be valid and is marked so on the host.
+ * 
+ * Parameter: gpu - context from ipv4_gpu_create(), may be NULL
+ */
+size_t ipv4_gpu_validate_lines(struct ipv4_gpu* gpu, const char* buf, size_t n, size_t* lines,
+                               uint8_t* valid_bitmap, uint32_t* addrs) {
+    if (gpu == NULL || n < IPV4_GPU_MIN_BYTES) {
+        return validate_ip_lines(buf, n, lines, valid_bitmap, addrs);
+    }
+#ifdef VALIDATE_IP_OPENCL
+    size_t cap = *lines, count = 0, pos = 0;
+    memset(valid_bitmap, 0, (cap + 7) / 8);
+    cl_int err = CL_SUCCESS;
+    
+    // Round robin over the slots: finish the oldest chunk, then refill its slot
+    for (int s = 0, idle = 0; idle < IPV4_GPU_SLOTS; s = (s + 1) % IPV4_GPU_SLOTS) {
+        struct ipv4_gpu_slot* slot = &gpu->slots[s];
+        if ((err = ipv4_gpu_finish(slot, valid_bitmap)) != CL_SUCCESS) {
+            break;
+        }
+        if (pos >= n || count >= cap) {
+            idle++;  // Input used up; just drain the other slots
+            continue;
+        }
+        
+        // Index the next chunk on the host while the other slot is on the device
+        size_t start = pos, chunk = 0;
+        size_t limit = cap - count < IPV4_GPU_CHUNK_LINES ? cap - count : IPV4_GPU_CHUNK_LINES;
+        while (pos < n && chunk < limit) {
+            const char* nl = memchr(buf + pos, '\n', n - pos);
+            size_t next = nl != NULL ? (size_t)(nl - buf) + 1 : n + 1;  // One past the '\n'
+            if (next - start > IPV4_GPU_CHUNK_BYTES) {
+                break;  // Does not fit; ends the chunk
+            }
+            slot->host_starts[chunk++] = (uint32_t)(pos - start);
+            pos = next < n ? next : n;
+            slot->host_starts[chunk] = (uint32_t)(next - start);
+        }
+        if (chunk == 0) {
+            // One line longer than a whole chunk: invalid, bit already clear
+            const char* nl = memchr(buf + pos, '\n', n - pos);
+            pos = nl != NULL ? (size_t)(nl - buf) + 1 : n;
+            if (addrs != NULL) {
+                addrs[count] = 0;
+            }
+            count++;
+            continue;
+        }
+        
+        size_t bytes = pos - start;
+        cl_uint chunk_lines = (cl_uint)chunk;
+        size_t global = (chunk + 63) / 64 * 64;
+        cl_event events[2];
+        err = clEnqueueWriteBuffer(slot->queue, slot->data, CL_FALSE, 0, bytes, buf + start,
+                                   0, NULL, NULL);
+        if (err == CL_SUCCESS) {
+            err = clEnqueueWriteBuffer(slot->queue, slot->starts, CL_FALSE, 0,
+                                       (chunk + 1) * sizeof(uint32_t), slot->host_starts, 0, NULL, NULL);
+        }
+        if (err == CL_SUCCESS) {
+            clSetKernelArg(gpu->kernel, 0, sizeof(cl_mem), &slot->data);
+            clSetKernelArg(gpu->kernel, 1, sizeof(cl_mem), &slot->starts);
+            clSetKernelArg(gpu->kernel, 2, sizeof(cl_uint), &chunk_lines);
+            clSetKernelArg(gpu->kernel, 3, sizeof(cl_mem), &slot->addrs);
+            err = clSetKernelArg(gpu->kernel, 4, sizeof(cl_mem), &slot->valid);
+        }
+        if (err == CL_SUCCESS) {
+            err = clEnqueueNDRangeKernel(slot->queue, gpu->kernel, 1, NULL, &global, NULL,
+                                         0, NULL, NULL);
+        }
+        if (err == CL_SUCCESS) {
+            err = clEnqueueReadBuffer(slot->queue, slot->valid, CL_FALSE, 0, chunk, slot->host_valid,
+                                      0, NULL, &events[0]);
+        }
+        if (err == CL_SUCCESS && addrs != NULL) {
+            err = clEnqueueReadBuffer(slot->queue, slot->addrs, CL_FALSE, 0, chunk * sizeof(uint32_t),
+                                      addrs + count, 0, NULL, &events[1]);
+            if (err == CL_SUCCESS) {
+                clReleaseEvent(events[0]);  // The in-order queue finishes this read last
+                events[0] = events[1];
+            } else {
+                clReleaseEvent(events[0]);
+            }
+        }
+        if (err != CL_SUCCESS) {
+            break;
+        }
+        clFlush(slot->queue);
+        slot->done = events[0];
+        slot->first_line = count;
+        slot->lines = chunk;
+        count += chunk;
+    }
+    
+    if (err != CL_SUCCESS) {
+        // Let everything already queued complete, then redo the whole batch on the CPU
+        for (int s = 0; s < IPV4_GPU_SLOTS; s++) {
+            struct ipv4_gpu_slot* slot = &gpu->slots[s];
+            clFinish(slot->queue);
+            if (slot->done != NULL) {
+                clReleaseEvent(slot->done);
+                slot->done = NULL;
+            }
+            slot->lines = 0;
+        }
+        *lines = cap;
+        return validate_ip_lines(buf, n, lines, valid_bitmap, addrs);
+    }
+    *lines = count;
+    return pos;
+#else
+    return validate_ip_lines(buf, n, lines, valid_bitmap, addrs);
+#endif
+}
+
+/*
+ * Parse dialects
+ * 
+ * validate_ip() implements one strict dialect. Other producers emit the forms
+ * accepted by inet_aton(): 1-3 part addresses ("10.1" is 10.0.0.1, the last
+ * part filling the remaining bytes), "0x" hexadecimal parts and leading-zero
+ * octal parts. Each rule is a flag below; IPV4_DEFINE_DIALECT() turns a flag
+ * set into its own parser by inlining ipv4_parse_dialect() with the flags as
+ * a constant, so the compiler drops every test for a rule that is off and no
+ * flag is checked at run time. The strict functions above are not built this
+ * way and are unaffected.
+ */
+#if defined(__GNUC__)
+#define IPV4_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define IPV4_ALWAYS_INLINE inline
+#endif
+
+/*
+ * Generic dialect parser. Not meant to be called with a run-time flags value:
+ * use it through IPV4_DEFINE_DIALECT() so each flag set gets its own copy.
+ * 
+ * Unlike inet_aton() the whole slice must be the address (no trailing
+ * whitespace and text), and every part needs at least one digit ("0x" on
+ * its own is rejected).
+ */
+static IPV4_ALWAYS_INLINE int ipv4_parse_dialect(const char* ip, size_t len, uint32_t* out,
+                                                 const unsigned flags) {
+    if (ip == NULL || len == 0) {
+        return 0;  // Invalid: null pointer or empty string
+    }
+    
+    uint32_t addr = 0;   // Parts completed so far, packed most significant first
+    unsigned parts = 0;  // Number of parts completed (each followed by a dot)
+    size_t i = 0;
+    
+    for (;;) {
+        unsigned base = 10;
+        
+        // Base prefix: "0x" for hexadecimal, or a '0' followed by more digits for octal
+        if ((flags & (IPV4_DIALECT_HEX | IPV4_DIALECT_OCTAL)) &&
+            ip[i] == '0' && i + 1 < len && ip[i + 1] != '.') {
+            if ((flags & IPV4_DIALECT_HEX) && (ip[i + 1] | 0x20) == 'x') {
+                base = 16;
+                i += 2;
+            } else if (flags & IPV4_DIALECT_OCTAL) {
+                base = 8;
+                i++;
+            }
+        }
+        
+        // Digits of the part
+        size_t start = i;
+        uint64_t value = 0;
+        for (; i < len; i++) {
+            int d = ipv6_hex((unsigned char)ip[i]);
+            if (d < 0 || (unsigned)d >= base) {
+                break;
+            }
+            if (!(flags & (IPV4_DIALECT_LEADING_ZEROS | IPV4_DIALECT_OCTAL)) &&
+                i > start && value == 0) {
+                return 0;  // Invalid: leading zeros not allowed
+            }
+            value = value * base + (unsigned)d;
+            if (value > 0xFFFFFFFFu) {
+                return 0;  // Invalid: part does not fit in 32 bits
+            }
+        }
+        if (i == start) {
+            return 0;  // Invalid: empty part, or a prefix without digits
+        }
+        
+        if (i == len) {
+            // Last part fills whatever bytes the earlier parts left
+            if (!(flags & IPV4_DIALECT_SHORT_FORMS) && parts != 3) {
+                return 0;  // Invalid: wrong number of octets
+            }
+            if (value > (0xFFFFFFFFu >> (8 * parts))) {
+                return 0;  // Invalid: last part too large for the bytes left
+            }
+            if (out != NULL) {
+                *out = (parts == 0 ? 0 : addr << (8 * (4 - parts))) | (uint32_t)value;
+            }
+            return 1;  // Valid address in this dialect
+        }
+        
+        if (ip[i] != '.' || parts == 3 || value > 0xFF) {
+            return 0;  // Invalid: bad character, too many dots, or part above 255
+        }
+        addr = (addr << 8) | (uint32_t)value;
+        parts++;
+        i++;
+        if (i == len) {
+            return 0;  // Invalid: trailing dot
+        }
+    }
+}
+
+/*
+ * Defines int name(const char* ip, size_t len, uint32_t* out), a parser for
+ * the given dialect flags with the same contract as parse_ipv4()
+ */
+#define IPV4_DEFINE_DIALECT(name, flags) \
+    int name(const char* ip, size_t len, uint32_t* out) { \
+        return ipv4_parse_dialect(ip, len, out, (flags)); \
+    }
+
+/**
+ * Function: parse_ipv4_aton
+ * Purpose: Validates and decodes an address using the inet_aton() rules
+ * 
+ * Accepts "10.1", "0x0A.0.0.1", "012.0.0.1" and so on, with the same results
+ * as inet_aton() for any slice that holds only the address.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid, may be NULL. Left untouched when invalid.
+ * Returns: 1 if valid, 0 if invalid
+ */
+IPV4_DEFINE_DIALECT(parse_ipv4_aton, IPV4_DIALECT_ATON)
+
+/**
+ * Function: parse_ipv4_zero_padded
+ * Purpose: Strict dotted-quad, except that octets may carry leading zeros
+ * 
+ * For producers that zero-pad to fixed width: "010.001.002.003" is 10.1.2.3,
+ * not octal.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid, may be NULL. Left untouched when invalid.
+ * Returns: 1 if valid, 0 if invalid
+ */
+IPV4_DEFINE_DIALECT(parse_ipv4_zero_padded, IPV4_DIALECT_LEADING_ZEROS)
+
+/*
+ * Formatting
+ * 
+ * Text of every octet value followed by a '.', padded with more dots to 4
+ * bytes. Formatting an octet is then one 4-byte copy and a pointer bump by
+ * its length (plus one to keep the dot), with no division at run time.
+ */
+static const char ipv4_octet_text[256][4] = {
+    {'0','.','.','.'}, {'1','.','.','.'}, {'2','.','.','.'}, {'3','.','.','.'}, {'4','.','.','.'}, {'5','.','.','.'}, {'6','.','.','.'}, {'7','.','.','.'},
+    {'8','.','.','.'}, {'9','.','.','.'}, {'1','0','.','.'}, {'1','1','.','.'}, {'1','2','.','.'}, {'1','3','.','.'}, {'1','4','.','.'}, {'1','5','.','.'},
+    {'1','6','.','.'}, {'1','7','.','.'}, {'1','8','.','.'}, {'1','9','.','.'}, {'2','0','.','.'}, {'2','1','.','.'}, {'2','2','.','.'}, {'2','3','.','.'},
+    {'2','4','.','.'}, {'2','5','.','.'}, {'2','6','.','.'}, {'2','7','.','.'}, {'2','8','.','.'}, {'2','9','.','.'}, {'3','0','.','.'}, {'3','1','.','.'},
+    {'3','2','.','.'}, {'3','3','.','.'}, {'3','4','.','.'}, {'3','5','.','.'}, {'3','6','.','.'}, {'3','7','.','.'}, {'3','8','.','.'}, {'3','9','.','.'},
+    {'4','0','.','.'}, {'4','1','.','.'}, {'4','2','.','.'}, {'4','3','.','.'}, {'4','4','.','.'}, {'4','5','.','.'}, {'4','6','.','.'}, {'4','7','.','.'},
+    {'4','8','.','.'}, {'4','9','.','.'}, {'5','0','.','.'}, {'5','1','.','.'}, {'5','2','.','.'}, {'5','3','.','.'}, {'5','4','.','.'}, {'5','5','.','.'},
+    {'5','6','.','.'}, {'5','7','.','.'}, {'5','8','.','.'}, {'5','9','.','.'}, {'6','0','.','.'}, {'6','1','.','.'}, {'6','2','.','.'}, {'6','3','.','.'},
+    {'6','4','.','.'}, {'6','5','.','.'}, {'6','6','.','.'}, {'6','7','.','.'}, {'6','8','.','.'}, {'6','9','.','.'}, {'7','0','.','.'}, {'7','1','.','.'},
+    {'7','2','.','.'}, {'7','3','.','.'}, {'7','4','.','.'}, {'7','5','.','.'}, {'7','6','.','.'}, {'7','7','.','.'}, {'7','8','.','.'}, {'7','9','.','.'},
+    {'8','0','.','.'}, {'8','1','.','.'}, {'8','2','.','.'}, {'8','3','.','.'}, {'8','4','.','.'}, {'8','5','.','.'}, {'8','6','.','.'}, {'8','7','.','.'},
+    {'8','8','.','.'}, {'8','9','.','.'}, {'9','0','.','.'}, {'9','1','.','.'}, {'9','2','.','.'}, {'9','3','.','.'}, {'9','4','.','.'}, {'9','5','.','.'},
+    {'9','6','.','.'}, {'9','7','.','.'}, {'9','8','.','.'}, {'9','9','.','.'}, {'1','0','0','.'}, {'1','0','1','.'}, {'1','0','2','.'}, {'1','0','3','.'},
+    {'1','0','4','.'}, {'1','0','5','.'}, {'1','0','6','.'}, {'1','0','7','.'}, {'1','0','8','.'}, {'1','0','9','.'}, {'1','1','0','.'}, {'1','1','1','.'},
+    {'1','1','2','.'}, {'1','1','3','.'}, {'1','1','4','.'}, {'1','1','5','.'}, {'1','1','6','.'}, {'1','1','7','.'}, {'1','1','8','.'}, {'1','1','9','.'},
+    {'1','2','0','.'}, {'1','2','1','.'}, {'1','2','2','.'}, {'1','2','3','.'}, {'1','2','4','.'}, {'1','2','5','.'}, {'1','2','6','.'}, {'1','2','7','.'},
+    {'1','2','8','.'}, {'1','2','9','.'}, {'1','3','0','.'}, {'1','3','1','.'}, {'1','3','2','.'}, {'1','3','3','.'}, {'1','3','4','.'}, {'1','3','5','.'},
+    {'1','3','6','.'}, {'1','3','7','.'}, {'1','3','8','.'}, {'1','3','9','.'}, {'1','4','0','.'}, {'1','4','1','.'}, {'1','4','2','.'}, {'1','4','3','.'},
+    {'1','4','4','.'}, {'1','4','5','.'}, {'1','4','6','.'}, {'1','4','7','.'}, {'1','4','8','.'}, {'1','4','9','.'}, {'1','5','0','.'}, {'1','5','1','.'},
+    {'1','5','2','.'}, {'1','5','3','.'}, {'1','5','4','.'}, {'1','5','5','.'}, {'1','5','6','.'}, {'1','5','7','.'}, {'1','5','8','.'}, {'1','5','9','.'},
+    {'1','6','0','.'}, {'1','6','1','.'}, {'1','6','2','.'}, {'1','6','3','.'}, {'1','6','4','.'}, {'1','6','5','.'}, {'1','6','6','.'}, {'1','6','7','.'},
+    {'1','6','8','.'}, {'1','6','9','.'}, {'1','7','0','.'}, {'1','7','1','.'}, {'1','7','2','.'}, {'1','7','3','.'}, {'1','7','4','.'}, {'1','7','5','.'},
+    {'1','7','6','.'}, {'1','7','7','.'}, {'1','7','8','.'}, {'1','7','9','.'}, {'1','8','0','.'}, {'1','8','1','.'}, {'1','8','2','.'}, {'1','8','3','.'},
+    {'1','8','4','.'}, {'1','8','5','.'}, {'1','8','6','.'}, {'1','8','7','.'}, {'1','8','8','.'}, {'1','8','9','.'}, {'1','9','0','.'}, {'1','9','1','.'},
+    {'1','9','2','.'}, {'1','9','3','.'}, {'1','9','4','.'}, {'1','9','5','.'}, {'1','9','6','.'}, {'1','9','7','.'}, {'1','9','8','.'}, {'1','9','9','.'},
+    {'2','0','0','.'}, {'2','0','1','.'}, {'2','0','2','.'}, {'2','0','3','.'}, {'2','0','4','.'}, {'2','0','5','.'}, {'2','0','6','.'}, {'2','0','7','.'},
+    {'2','0','8','.'}, {'2','0','9','.'}, {'2','1','0','.'}, {'2','1','1','.'}, {'2','1','2','.'}, {'2','1','3','.'}, {'2','1','4','.'}, {'2','1','5','.'},
+    {'2','1','6','.'}, {'2','1','7','.'}, {'2','1','8','.'}, {'2','1','9','.'}, {'2','2','0','.'}, {'2','2','1','.'}, {'2','2','2','.'}, {'2','2','3','.'},
+    {'2','2','4','.'}, {'2','2','5','.'}, {'2','2','6','.'}, {'2','2','7','.'}, {'2','2','8','.'}, {'2','2','9','.'}, {'2','3','0','.'}, {'2','3','1','.'},
+    {'2','3','2','.'}, {'2','3','3','.'}, {'2','3','4','.'}, {'2','3','5','.'}, {'2','3','6','.'}, {'2','3','7','.'}, {'2','3','8','.'}, {'2','3','9','.'},
+    {'2','4','0','.'}, {'2','4','1','.'}, {'2','4','2','.'}, {'2','4','3','.'}, {'2','4','4','.'}, {'2','4','5','.'}, {'2','4','6','.'}, {'2','4','7','.'},
+    {'2','4','8','.'}, {'2','4','9','.'}, {'2','5','0','.'}, {'2','5','1','.'}, {'2','5','2','.'}, {'2','5','3','.'}, {'2','5','4','.'}, {'2','5','5','.'},
+};
+
+// Digits in an octet value
+#define IPV4_OCTET_LEN(o) (1u + ((o) >= 10) + ((o) >= 100))
+
+/*
+ * Writes addr as dotted-quad at out. Stores whole 4-byte table entries, so
+ * up to 3 bytes past the text (but never past out + 15) are scribbled on.
+ */
+static inline size_t ipv4_format_raw(uint32_t addr, char* out) {
+    char* p = out;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        unsigned octet = (addr >> shift) & 0xFF;
+        memcpy(p, ipv4_octet_text[octet], 4);
+        p += IPV4_OCTET_LEN(octet) + 1;
+    }
+    return (size_t)(p - out) - 1;  // The last octet's dot is not part of the text
+}
+
+/**
+ * Function: format_ipv4
+ * Purpose: Writes a packed address in strict dotted-quad form
+ * 
+ * The inverse of parse_ipv4(): the result is always accepted by validate_ip()
+ * and parses back to addr.
+ * 
+ * Parameter: addr - packed address, first octet in the most significant byte
+ * Parameter: out  - buffer of at least IPV4_FORMAT_SIZE bytes; receives the
+ *                   null-terminated text
+ * Returns: length of the text, 7-15
+ */
+size_t format_ipv4(uint32_t addr, char out[IPV4_FORMAT_SIZE]) {
+    size_t len = ipv4_format_raw(addr, out);
+    out[len] = '\0';
+    return len;
+}
+
+/**
+ * Function: format_ipv4_batch
+ * Purpose: Writes many packed addresses back to back into one buffer
+ * 
+ * Each address is followed by sep (e.g. '\n'), with no '\0' anywhere, so the
+ * output can be written out as it is. Pairs with the addrs column of
+ * validate_ip_batch().
+ * 
+ * Parameter: addrs - n packed addresses
+ * Parameter: n     - number of addresses
+ * Parameter: sep   - character written after each address
+ * Parameter: out   - buffer of at least n * IPV4_FORMAT_SIZE bytes
+ * Returns: number of bytes written
+ */
+size_t format_ipv4_batch(const uint32_t* addrs, size_t n, char sep, char* out) {
+    char* p = out;
+    for (size_t i = 0; i < n; i++) {
+        p += ipv4_format_raw(addrs[i], p);
+        *p++ = sep;
+    }
+    return (size_t)(p - out);
+}
+
+/**
+ * Function: ipv4_canonicalize
+ * Purpose: Rewrites any inet_aton()-style address in strict dotted-quad form
+ * 
+ * "10.1" becomes "10.0.0.1", "0x0A.0.0.1" becomes "10.0.0.1" and "012.0.0.1"
+ * (octal) becomes "10.0.0.1". Strict input comes back unchanged.
+ * 
+ * Parameter: ip  - pointer to the characters to convert (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - buffer of at least IPV4_FORMAT_SIZE bytes; receives the
+ *                  null-terminated strict form when valid, untouched when invalid
+ * Returns: length of the strict form, or 0 if the input is not valid under
+ *          the inet_aton() rules
+ */
+size_t ipv4_canonicalize(const char* ip, size_t len, char out[IPV4_FORMAT_SIZE]) {
+    uint32_t addr;
+    if (!parse_ipv4_aton(ip, len, &addr)) {
+        return 0;
+    }
+    return format_ipv4(addr, out);
+}
+
+/*
+ * Works out why a candidate that parse_ipv4() rejected is invalid. Only ever
+ * run after a failure, so it is kept out of line and written for clarity: it
+ * applies the checks in the same order as the original validate_ip() (length,
+ * characters, dot count, then each octet in turn), so the first broken rule is
+ * the one reported.
+ */
+IPV4_COLD
+static enum ipv4_error ipv4_diagnose(const char* ip, size_t len, size_t* pos) {
+    if (ip == NULL || len < 7 || len > 15) {
+        *pos = ip == NULL ? 0 : (len > 15 ? 15 : len);
+        return IPV4_ERR_LENGTH;
+    }
+    
+    // First bad character, counting dots along the way
+    size_t dots = 0, fourth_dot = len;
+    for (size_t i = 0; i < len; i++) {
+        if (ip[i] == '.') {
+            if (++dots == 4) {
+                fourth_dot = i;
+            }
+        } else if ((unsigned)((unsigned char)ip[i] - '0') > 9) {
+            *pos = i;
+            return IPV4_ERR_CHARACTER;
+        }
+    }
+    if (dots != 3) {
+        *pos = dots > 3 ? fourth_dot : len;
+        return IPV4_ERR_DOT_COUNT;
+    }
+    
+    // Each octet in order
+    size_t start = 0;
+    while (start <= len) {
+        size_t end = start;
+        while (end < len && ip[end] != '.') {
+            end++;
+        }
+        *pos = start;
+        if (end == start) {
+            return IPV4_ERR_EMPTY_OCTET;
+        }
+        if (end - start > 1 && ip[start] == '0') {
+            return IPV4_ERR_LEADING_ZERO;
+        }
+        unsigned value = 0;
+        for (size_t i = start; i < end && value <= 255; i++) {
+            value = value * 10 + (unsigned)(ip[i] - '0');
+        }
+        if (value > 255) {
+            return IPV4_ERR_RANGE;
+        }
+        start = end + 1;
+    }
+    
+    *pos = 0;
+    return IPV4_OK;  // Not reached for inputs parse_ipv4() rejected
+}
+
+/**
+ * Function: parse_ipv4_ex
+ * Purpose: parse_ipv4() that also reports why and where a candidate is invalid
+ * 
+ * Valid input costs exactly one parse_ipv4() call: the reason is only worked out
+ * by a separate, out-of-line re-scan after the fast parser has already said no.
+ * 
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid, may be NULL
+ * Parameter: pos - receives the byte offset the error refers to (0 when valid), may be
+ *                  NULL: the offending character, the 4th dot, the start of the empty,
+ *                  zero-led or out-of-range octet, or the length for length and
+ *                  too-few-dots errors (15 for over-long input)
+ * Returns: IPV4_OK if valid, otherwise the first rule the candidate breaks
+ */
+enum ipv4_error parse_ipv4_ex(const char* ip, size_t len, uint32_t* out, size_t* pos) {
+    size_t where = 0;
+    enum ipv4_error err = parse_ipv4(ip, len, out) ? IPV4_OK : ipv4_diagnose(ip, len, &where);
+    if (pos != NULL) {
+        *pos = where;
+    }
+    return err;
+}
+
+/**
+ * Function: ipv4_error_string
+ * Purpose: Short human readable description of an ipv4_error value
+ */
+const char* ipv4_error_string(enum ipv4_error err) {
+    switch (err) {
+    case IPV4_OK:               return "valid";
+    case IPV4_ERR_LENGTH:       return "length must be 7-15 characters";
+    case IPV4_ERR_CHARACTER:    return "only digits and dots are allowed";
+    case IPV4_ERR_DOT_COUNT:    return "exactly 3 dots are required";
+    case IPV4_ERR_EMPTY_OCTET:  return "empty octet";
+    case IPV4_ERR_LEADING_ZERO: return "leading zeros are not allowed";
+    case IPV4_ERR_RANGE:        return "octet is greater than 255";
+    }
+    return "unknown error";
+}
+
+_Static_assert(IPV4_ERR_RANGE + 1 == IPV4_STATS_REASONS, "IPV4_STATS_REASONS out of date");
+
+#ifdef VALIDATE_IP_STATS
+static void ipv4_stats_reject(struct ipv4_stats_block* block, const char* ip, size_t len) {
+    size_t pos;
+    ipv4_stats_add(&block->rejects[ipv4_diagnose(ip, len, &pos)], 1);
+}
+
+static void ipv4_stats_merge(struct ipv4_stats* out, const struct ipv4_stats_block* block) {
+    out->calls += atomic_load_explicit(&block->calls, memory_order_relaxed);
+    out->accepts += atomic_load_explicit(&block->accepts, memory_order_relaxed);
+    out->bytes += atomic_load_explicit(&block->bytes, memory_order_relaxed);
+    out->samples += atomic_load_explicit(&block->samples, memory_order_relaxed);
+    for (int r = 0; r < IPV4_STATS_REASONS; r++) {
+        out->rejects[r] += atomic_load_explicit(&block->rejects[r], memory_order_relaxed);
+    }
+    for (int b = 0; b < IPV4_STATS_BUCKETS; b++) {
+        out->latency[b] += atomic_load_explicit(&block->latency[b], memory_order_relaxed);
+    }
+}
+#endif
+
+/**
+ * Function: ipv4_stats_snapshot
+ * Purpose: Adds up the instrumentation counters of every thread
+ * 
+ * Safe to call at any time from any thread. Counters keep running while it
+ * reads them, so the totals are a moment-in-time view only to within the calls
+ * in flight. Without VALIDATE_IP_STATS everything is zero.
+ * 
+ * Parameter: out - receives the totals
+ * Returns: 1 if built with VALIDATE_IP_STATS, 0 if not
+ */
+int ipv4_stats_snapshot(struct ipv4_stats* out) {
+    memset(out, 0, sizeof(*out));
+#ifdef VALIDATE_IP_STATS
+    for (const struct ipv4_stats_block* block =
+             atomic_load_explicit(&ipv4_stats_head, memory_order_acquire);
+         block != NULL; block = block->next) {
+        ipv4_stats_merge(out, block);
+    }
+    ipv4_stats_merge(out, &ipv4_stats_fallback);  // Not on the list
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Function: ipv4_find_next
+ * Purpose: Finds the next valid IPv4 address embedded in arbitrary text
+ * 
+ * A candidate is a maximal run of digits and dots. Dots at either end of the
+ * run are dropped, so sentence punctuation like "from 10.0.0.1." still matches,
+ * and what is left must be a valid address as a whole. Runs such as
+ * "1.2.3.4.5" or "10.0.0.256" therefore produce no match at all rather than a
+ * misleading partial one. Any other character (letters, ':', '/', spaces, ...)
+ * ends a run, so "host-10.0.0.1:80" matches "10.0.0.1".
+ * 
+ * Candidates are located with memchr() for '.', which is vectorized in every
+ * mainstream C library. Only the digits and dots next to each dot found (plus
+ * the byte on either side that ends the run) are then scanned one byte at a
+ * time, and only runs of a plausible length reach the full parser.
+ * 
+ * Parameter: buf   - text to search (need not be null-terminated)
+ * Parameter: n     - number of bytes in buf
+ * Parameter: pos   - in: offset to resume searching from (0 to start);
+ *                    out: offset to pass to the next call
+ * Parameter: match - receives the address when one is found
+ * Returns: 1 if an address was found, 0 when there are no more addresses
+ */
+int ipv4_find_next(const char* buf, size_t n, size_t* pos, struct ipv4_match* match) {
+    size_t i = *pos;
+    
+    while (i < n) {
+        // Every address contains a dot, so jump straight to the next one
+        const char* dot = memchr(buf + i, '.', n - i);
+        if (dot == NULL) {
+            break;  // No more dots means no more addresses
+        }
+        
+        // Widen the dot to the whole run of digits and dots around it
+        size_t start = (size_t)(dot - buf);
+        while (start > i && ipv4_is_addr_char((unsigned char)buf[start - 1])) {
+            start--;
+        }
+        size_t end = (size_t)(dot - buf) + 1;
+        while (end < n && ipv4_is_addr_char((unsigned char)buf[end])) {
+            end++;
+        }
+        i = end;  // Whatever happens, this run is done with
+        
+        // Drop leading and trailing dots, then the rest must be an address
+        while (start < end && buf[start] == '.') {
+            start++;
+        }
+        while (end > start && buf[end - 1] == '.') {
+            end--;
+        }
+        if (end - start >= 7 && end - start <= 15 &&
+            parse_ipv4(buf + start, end - start, &match->addr)) {
+            match->offset = start;
+            match->length = end - start;
+            *pos = i;
+            return 1;
+        }
+    }
+    
+    *pos = n;
+    return 0;
+}
+
+/*
+ * Arena for extraction results
+ * 
+ * A bump allocator over a list of chunks owned by one caller (typically one
+ * per thread, like struct ipv4_cache). Allocating is a pointer bump inside the
+ * current chunk, and ipv4_arena_reset() makes all of it reusable at once while
+ * keeping the chunks, so after warm-up scanning a batch never calls malloc().
+ * Each new chunk is twice the size of the one before, up to
+ * IPV4_ARENA_MAX_CHUNK, so the number of chunks stays small for any batch.
+ */
+struct ipv4_arena_chunk {
+    struct ipv4_arena_chunk* next;  // Next chunk, reused in order after a reset
+    size_t size;                    // Bytes available at data
+    size_t used;                    // Bytes handed out so far
+    _Alignas(IPV4_ARENA_ALIGN) unsigned char data[];
+};
+
+// Largest request that can be rounded up and given a chunk header without wrapping around
+#define IPV4_ARENA_MAX_SIZE (SIZE_MAX - sizeof(struct ipv4_arena_chunk) - IPV4_ARENA_ALIGN)
+
+/**
+ * Function: ipv4_arena_init
+ * Purpose: Prepares an empty arena; no memory is allocated until first use
+ * 
+ * Parameter: arena      - arena to initialize
+ * Parameter: chunk_size - size of the first chunk in bytes, 0 for IPV4_ARENA_DEFAULT_CHUNK
+ */
+void ipv4_arena_init(struct ipv4_arena* arena, size_t chunk_size) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->chunk_size = chunk_size != 0 ? chunk_size : IPV4_ARENA_DEFAULT_CHUNK;
+    arena->initial_chunk = arena->chunk_size;
+    arena->last = NULL;
+}
+
+// Moves to a chunk with at least size free bytes, reusing chunks kept by a reset
+IPV4_COLD static struct ipv4_arena_chunk* ipv4_arena_next_chunk(struct ipv4_arena* arena, size_t size) {
+    // Chunks after current are empty after a reset; skip any too small for this request
+    struct ipv4_arena_chunk** link = arena->current != NULL ? &arena->current->next : &arena->first;
+    while (*link != NULL && (*link)->size < size) {
+        link = &(*link)->next;
+    }
+    if (*link == NULL) {
+        size_t bytes = arena->chunk_size > size ? arena->chunk_size : size;
+        struct ipv4_arena_chunk* chunk = malloc(sizeof(*chunk) + bytes);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->size = bytes;
+        chunk->used = 0;
+        *link = chunk;
+        if (arena->chunk_size < IPV4_ARENA_MAX_CHUNK) {
+            arena->chunk_size *= 2;
+        }
+    }
+    arena->current = *link;
+    return arena->current;
+}
+
+/**
+ * Function: ipv4_arena_alloc
+ * Purpose: Allocates size bytes, aligned to IPV4_ARENA_ALIGN, from the arena
+ * 
+ * Parameter: arena - arena to allocate from
+ * Parameter: size  - number of bytes
+ * Returns: the memory, valid until the next ipv4_arena_reset(), or NULL when out of
+ *          memory or when size is too large to allocate at all
+ */
+void* ipv4_arena_alloc(struct ipv4_arena* arena, size_t size) {
+    if (size > IPV4_ARENA_MAX_SIZE) {
+        return NULL;  // Rounding up, or adding the chunk header, would wrap around
+    }
+    size = (size + IPV4_ARENA_ALIGN - 1) & ~(size_t)(IPV4_ARENA_ALIGN - 1);
+    struct ipv4_arena_chunk* chunk = arena->current;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk = ipv4_arena_next_chunk(arena, size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+    }
+    void* p = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->last = p;
+    return p;
+}
+
+/**
+ * Function: ipv4_arena_grow
+ * Purpose: Enlarges an allocation, in place when it is the most recent one and fits
+ * 
+ * Parameter: arena    - arena p was allocated from
+ * Parameter: p        - allocation to grow, or NULL to allocate new
+ * Parameter: old_size - size p was allocated or last grown with
+ * Parameter: new_size - size needed, at least old_size
+ * Returns: the allocation (possibly moved, with the old contents copied), or
+ *          NULL when out of memory, in which case p is left as it was
+ */
+void* ipv4_arena_grow(struct ipv4_arena* arena, void* p, size_t old_size, size_t new_size) {
+    if (new_size > IPV4_ARENA_MAX_SIZE) {
+        return NULL;  // As in ipv4_arena_alloc(); extra below would wrap around too
+    }
+    old_size = (old_size + IPV4_ARENA_ALIGN - 1) & ~(size_t)(IPV4_ARENA_ALIGN - 1);
+    if (p != NULL && p == arena->last) {
+        size_t extra = ((new_size + IPV4_ARENA_ALIGN - 1) & ~(size_t)(IPV4_ARENA_ALIGN - 1)) - old_size;
+        struct ipv4_arena_chunk* chunk = arena->current;
+        if (chunk->size - chunk->used >= extra) {
+            chunk->used += extra;
+            return p;
+        }
+    }
+    void* q = ipv4_arena_alloc(arena, new_size);
+    if (q != NULL && p != NULL) {
+        memcpy(q, p, old_size);
+    }
+    return q;
+}
+
+/**
+ * Function: ipv4_arena_reset
+ * Purpose: Frees every allocation at once, keeping the chunks for reuse
+ * 
+ * Parameter: arena - arena to reset
+ */
+void ipv4_arena_reset(struct ipv4_arena* arena) {
+    for (struct ipv4_arena_chunk* chunk = arena->first; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->first;
+    arena->last = NULL;
+}
+
+/**
+ * Function: ipv4_arena_release
+ * Purpose: Returns all of the arena's memory to the system; it can be used again afterwards
+ * 
+ * The arena starts over with the first-chunk size it was initialized with.
+ * 
+ * Parameter: arena - arena to release
+ */
+void ipv4_arena_release(struct ipv4_arena* arena) {
+    struct ipv4_arena_chunk* chunk = arena->first;
+    while (chunk != NULL) {
+        struct ipv4_arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    ipv4_arena_init(arena, arena->initial_chunk);
+}
+
+/**
+ * Function: ipv4_extract_all
+ * Purpose: Collects every address embedded in a buffer into one contiguous array
+ * 
+ * Finds the same addresses as repeated ipv4_find_next() calls. The array lives
+ * in the arena, so collecting the matches of a batch of lines costs no malloc()
+ * once the arena has warmed up, and the consumer walks them sequentially.
+ * 
+ * Parameter: arena   - arena to allocate the array from
+ * Parameter: buf     - text to search (need not be null-terminated)
+ * Parameter: n       - number of bytes in buf
+ * Parameter: matches - receives the array (NULL when there are no matches),
+ *                      valid until the next ipv4_arena_reset()
+ * Parameter: count   - receives the number of matches
+ * Returns: 1 on success, 0 when out of memory (*matches and *count then hold
+ *          the matches collected before running out)
+ */
+int ipv4_extract_all(struct ipv4_arena* arena, const char* buf, size_t n,
+                     struct ipv4_match** matches, size_t* count) {
+    struct ipv4_match* items = NULL;
+    size_t used = 0, cap = 0;
+    size_t pos = 0;
+    struct ipv4_match m;
+    int ok = 1;
+    while (ipv4_find_next(buf, n, &pos, &m)) {
+        if (used == cap) {
+            size_t grown = cap == 0 ? 16 : cap * 2;
+            struct ipv4_match* more = ipv4_arena_grow(arena, items, cap * sizeof(*items),
+                                                      grown * sizeof(*items));
+            if (more == NULL) {
+                ok = 0;
+                break;
+            }
+            items = more;
+            cap = grown;
+        }
+        items[used++] = m;
+    }
+    *matches = items;
+    *count = used;
+    return ok;
+}
+
+/**
+ * Function: parse_ipv4_cidr
+ * Purpose: Validates and decodes a CIDR block of the form a.b.c.d/nn
+ * 
+ * The address part follows the same rules as validate_ip(). The prefix length
+ * must be 0-32, written in decimal without leading zeros ("/08" is invalid).
+ * Host bits set in the address are accepted and cleared, so "10.1.2.3/8"
+ * yields the block 10.0.0.0/8.
+ * 
+ * Parameter: p   - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: n   - number of characters in the candidate block
+ * Parameter: out - receives the decoded block when valid, may be NULL
+ * Returns: 1 if valid CIDR block, 0 if invalid
+ */
+int parse_ipv4_cidr(const char* p, size_t n, struct ipv4_cidr* out) {
+    if (p == NULL) {
+        return 0;  // Invalid: null pointer means no string to validate
+    }
+    
+    // The address is at most 15 characters, so the slash is within the first 16
+    const char* slash = memchr(p, '/', n < 16 ? n : 16);
+    if (slash == NULL) {
+        return 0;  // Invalid: no prefix length
+    }
+    
+    uint32_t addr;
+    if (!parse_ipv4(p, (size_t)(slash - p), &addr)) {
+        return 0;  // Invalid: the address part is not a valid address
+    }
+    
+    // One or two digits, no leading zero, at most 32
+    const char* digits = slash + 1;
+    size_t count = n - (size_t)(digits - p);
+    unsigned d0 = count >= 1 ? (unsigned)((unsigned char)digits[0] - '0') : 10;
+    unsigned d1 = count == 2 ? (unsigned)((unsigned char)digits[1] - '0') : 0;
+    if (count < 1 || count > 2 || d0 > 9 || d1 > 9 || (count == 2 && d0 == 0)) {
+        return 0;  // Invalid: prefix length is not a plain decimal number
+    }
+    unsigned prefix = count == 2 ? d0 * 10 + d1 : d0;
+    if (prefix > 32) {
+        return 0;  // Invalid: prefix length is outside the 0-32 range
+    }
+    
+    if (out != NULL) {
+        out->mask = prefix != 0 ? 0xFFFFFFFFu << (32 - prefix) : 0;
+        out->network = addr & out->mask;
+        out->prefix = prefix;
+    }
+    return 1;  // Valid CIDR block
+}
+
+/**
+ * Function: ipv4_cidr_contains
+ * Purpose: Tests whether a packed address lies inside a CIDR block
+ * 
+ * Parameter: block - block from parse_ipv4_cidr()
+ * Parameter: addr  - packed address, as produced by parse_ipv4()
+ * Returns: 1 if addr is inside block, 0 otherwise
+ */
+int ipv4_cidr_contains(const struct ipv4_cidr* block, uint32_t addr) {
+    return (addr & block->mask) == block->network;
+}
+
+/*
+ * Membership engines for ipv4_cidr_match_batch(). Each handles a multiple of 8
+ * addresses, producing one bitmap byte per 8, and returns how many it handled;
+ * the caller finishes the tail with ipv4_cidr_contains().
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+static size_t ipv4_cidr_match_sse2(const struct ipv4_cidr* block, const uint32_t* addrs,
+                                   size_t n, uint8_t* bitmap, size_t* matches) {
+    __m128i mask = _mm_set1_epi32((int)block->mask);
+    __m128i network = _mm_set1_epi32((int)block->network);
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(addrs + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(addrs + i + 4));
+        unsigned bits = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(
+                            _mm_cmpeq_epi32(_mm_and_si128(lo, mask), network))) |
+                        (unsigned)_mm_movemask_ps(_mm_castsi128_ps(
+                            _mm_cmpeq_epi32(_mm_and_si128(hi, mask), network))) << 4;
+        bitmap[i / 8] = (uint8_t)bits;
+        count += (size_t)__builtin_popcount(bits);
+    }
+    *matches += count;
+    return i;
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("avx2,popcnt")))
+static size_t ipv4_cidr_match_avx2(const struct ipv4_cidr* block, const uint32_t* addrs,
+                                   size_t n, uint8_t* bitmap, size_t* matches) {
+    __m256i mask = _mm256_set1_epi32((int)block->mask);
+    __m256i network = _mm256_set1_epi32((int)block->network);
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(addrs + i));
+        unsigned bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(
+                            _mm256_cmpeq_epi32(_mm256_and_si256(v, mask), network)));
+        bitmap[i / 8] = (uint8_t)bits;
+        count += (size_t)__builtin_popcount(bits);
+    }
+    *matches += count;
+    return i;
+}
+#endif
+
+#ifdef IPV4_HAVE_NEON
+static size_t ipv4_cidr_match_neon(const struct ipv4_cidr* block, const uint32_t* addrs,
+                                   size_t n, uint8_t* bitmap, size_t* matches) {
+    static const uint32_t lo_bits[4] = {1, 2, 4, 8};
+    static const uint32_t hi_bits[4] = {16, 32, 64, 128};
+    uint32x4_t mask = vdupq_n_u32(block->mask);
+    uint32x4_t network = vdupq_n_u32(block->network);
+    uint32x4_t lo_w = vld1q_u32(lo_bits), hi_w = vld1q_u32(hi_bits);
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint32x4_t lo = vceqq_u32(vandq_u32(vld1q_u32(addrs + i), mask), network);
+        uint32x4_t hi = vceqq_u32(vandq_u32(vld1q_u32(addrs + i + 4), mask), network);
+        unsigned bits = vaddvq_u32(vorrq_u32(vandq_u32(lo, lo_w), vandq_u32(hi, hi_w)));
+        bitmap[i / 8] = (uint8_t)bits;
+        count += (size_t)__builtin_popcount(bits);
+    }
+    *matches += count;
+    return i;
+}
+#endif
+
+/**
+ * Function: ipv4_cidr_match_batch
+ * Purpose: Tests many packed addresses against one CIDR block
+ * 
+ * Eight addresses are masked and compared per step with one AVX2 compare (or a
+ * pair of SSE2/NEON compares), and the compare mask becomes a bitmap byte
+ * directly, so there is no branch per address.
+ * 
+ * Parameter: block  - block from parse_ipv4_cidr()
+ * Parameter: addrs  - array of n packed addresses
+ * Parameter: n      - number of addresses
+ * Parameter: bitmap - receives (n + 7) / 8 bytes; bit (i % 8) of byte (i / 8) is set
+ *                     when addrs[i] is inside block, unused bits of the last byte are cleared
+ * Returns: number of addresses inside block
+ */
+size_t ipv4_cidr_match_batch(const struct ipv4_cidr* block, const uint32_t* addrs,
+                             size_t n, uint8_t* bitmap) {
+    size_t matches = 0, i = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        i = ipv4_cidr_match_avx2(block, addrs, n, bitmap, &matches);
+    }
+#endif
+#if defined(__SSE2__)
+    if (i == 0) {
+        i = ipv4_cidr_match_sse2(block, addrs, n, bitmap, &matches);
+    }
+#elif defined(IPV4_HAVE_NEON)
+    i = ipv4_cidr_match_neon(block, addrs, n, bitmap, &matches);
+#endif
+    
+    // Whatever is left (all of it without SIMD) one address at a time
+    for (; i < n; i += 8) {
+        unsigned bits = 0;
+        for (size_t j = 0; j < 8 && i + j < n; j++) {
+            unsigned in = (unsigned)ipv4_cidr_contains(block, addrs[i + j]);
+            bits |= in << j;
+            matches += in;
+        }
+        bitmap[i / 8] = (uint8_t)bits;
+    }
+    return matches;
+}
+
+/*
+ * Longest-prefix match
+ * 
+ * A DIR-24-8 table: one 2^24-entry table indexed by the top 24 bits of the
+ * address, plus 256-entry extension groups for /24s that contain longer
+ * prefixes. Both live in one contiguous allocation, and a lookup touches at
+ * most two entries. Each 32-bit entry carries a 24-bit value, the length of
+ * the prefix that wrote it (so prefixes can be added in any order and a
+ * shorter one never overwrites a longer one), and valid/extension flags.
+ */
+
+#define IPV4_LPM_VALID      0x80000000u  // Entry holds a value
+#define IPV4_LPM_EXTENDED   0x40000000u  // tbl24 entry points to a tbl8 group instead
+#define IPV4_LPM_DEPTH_SHIFT 24          // Bits 24-29: prefix length that wrote the entry
+#define IPV4_LPM_PAYLOAD    0x00FFFFFFu  // Bits 0-23: value, or tbl8 group index
+
+_Static_assert(IPV4_LPM_MAX_VALUE == IPV4_LPM_PAYLOAD, "IPV4_LPM_MAX_VALUE out of date");
+
+struct ipv4_lpm {
+    uint32_t* tbl24;        // 2^24 entries, one per /24
+    uint32_t* tbl8;         // tbl8_groups groups of 256 entries, right after tbl24
+    uint32_t tbl8_groups;   // Number of groups allocated
+    uint32_t tbl8_used;     // Number of groups handed out so far
+};
+
+/**
+ * Function: ipv4_lpm_create
+ * Purpose: Allocates an empty longest-prefix-match table
+ * 
+ * The table is one zeroed allocation of 64 MiB plus 1 KiB per extension group;
+ * memory is only committed as entries are written. One group is needed for
+ * every distinct /24 that contains a prefix longer than /24.
+ * 
+ * Parameter: tbl8_groups - number of extension groups to reserve (at most 2^24)
+ * Returns: the new table, or NULL if it could not be allocated
+ */
+struct ipv4_lpm* ipv4_lpm_create(uint32_t tbl8_groups) {
+    if (tbl8_groups > IPV4_LPM_PAYLOAD + 1) {
+        return NULL;  // Group indices must fit in the entry payload
+    }
+    struct ipv4_lpm* lpm = malloc(sizeof(*lpm));
+    uint32_t* arena = calloc(((size_t)1 << 24) + (size_t)tbl8_groups * 256, sizeof(uint32_t));
+    if (lpm == NULL || arena == NULL) {
+        free(lpm);
+        free(arena);
+        return NULL;
+    }
+    lpm->tbl24 = arena;
+    lpm->tbl8 = arena + ((size_t)1 << 24);
+    lpm->tbl8_groups = tbl8_groups;
+    lpm->tbl8_used = 0;
+    return lpm;
+}
+
+/**
+ * Function: ipv4_lpm_free
+ * Purpose: Releases a table created by ipv4_lpm_create()
+ */
+void ipv4_lpm_free(struct ipv4_lpm* lpm) {
+    if (lpm != NULL) {
+        free(lpm->tbl24);
+        free(lpm);
+    }
+}
+
+// Writes entry into count consecutive entries, skipping those owned by longer prefixes
+static void ipv4_lpm_fill(uint32_t* entries, size_t count, uint32_t entry, unsigned depth) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t e = entries[i];
+        if (!(e & IPV4_LPM_VALID) || ((e >> IPV4_LPM_DEPTH_SHIFT) & 0x3F) <= depth) {
+            entries[i] = entry;
+        }
+    }
+}
+
+/**
+ * Function: ipv4_lpm_add
+ * Purpose: Adds (or replaces) a prefix in the table
+ * 
+ * Prefixes may be added in any order. Adding the same prefix twice keeps the
+ * later value.
+ * 
+ * Parameter: lpm   - table to add to
+ * Parameter: block - prefix to add, from parse_ipv4_cidr(); only block->prefix and the
+ *                    network bits of block->network are used
+ * Parameter: value - value to return for addresses matching block, at most IPV4_LPM_MAX_VALUE
+ * Returns: 1 on success, 0 if value is too large or the extension groups are used up
+ */
+int ipv4_lpm_add(struct ipv4_lpm* lpm, const struct ipv4_cidr* block, uint32_t value) {
+    if (value > IPV4_LPM_MAX_VALUE || block->prefix > 32) {
+        return 0;
+    }
+    unsigned depth = block->prefix;
+    
+    // From the prefix alone, so a hand-filled block with host bits set stays inside its range
+    uint32_t network = depth == 0 ? 0 : block->network & (0xFFFFFFFFu << (32 - depth));
+    uint32_t entry = IPV4_LPM_VALID | ((uint32_t)depth << IPV4_LPM_DEPTH_SHIFT) | value;
+    
+    if (depth <= 24) {
+        // Covers whole /24s: update the tbl24 entries, or the groups they point to
+        size_t first = network >> 8;
+        size_t count = (size_t)1 << (24 - depth);
+        for (size_t i = first; i < first + count; i++) {
+            uint32_t e = lpm->tbl24[i];
+            if (e & IPV4_LPM_EXTENDED) {
+                ipv4_lpm_fill(lpm->tbl8 + (size_t)(e & IPV4_LPM_PAYLOAD) * 256, 256, entry, depth);
+            } else {
+                ipv4_lpm_fill(lpm->tbl24 + i, 1, entry, depth);
+            }
+        }
+        return 1;
+    }
+    
+    // Longer than /24: work inside the extension group of its /24, creating it if needed
+    uint32_t* slot = &lpm->tbl24[network >> 8];
+    if (!(*slot & IPV4_LPM_EXTENDED)) {
+        if (lpm->tbl8_used == lpm->tbl8_groups) {
+            return 0;  // No extension group left
+        }
+        uint32_t group = lpm->tbl8_used++;
+        uint32_t* g = lpm->tbl8 + (size_t)group * 256;
+        for (size_t j = 0; j < 256; j++) {
+            g[j] = *slot;  // The group starts out as whatever covered the whole /24
+        }
+        *slot = IPV4_LPM_EXTENDED | group;
+    }
+    uint32_t* g = lpm->tbl8 + (size_t)(*slot & IPV4_LPM_PAYLOAD) * 256;
+    ipv4_lpm_fill(g + (network & 0xFF), (size_t)1 << (32 - depth), entry, depth);
+    return 1;
+}
+
+// Shortest prefix first; equal prefixes keep their input order
+static int ipv4_lpm_order(const void* a, const void* b) {
+    const struct ipv4_cidr* const* x = a;
+    const struct ipv4_cidr* const* y = b;
+    if ((*x)->prefix != (*y)->prefix) {
+        return (*x)->prefix < (*y)->prefix ? -1 : 1;
+    }
+    return *x < *y ? -1 : (*x > *y);
+}
+
+/**
+ * Function: ipv4_lpm_build
+ * Purpose: Adds many prefixes at once
+ * 
+ * Inserts from shortest to longest prefix. Every extension group is then
+ * created after all shorter prefixes covering it are already in tbl24, so it
+ * starts out correct instead of being patched entry by entry by shorter
+ * prefixes that arrive later. When the same prefix appears more than once the
+ * last value wins.
+ * 
+ * Parameter: lpm    - table to add to
+ * Parameter: blocks - array of n prefixes
+ * Parameter: values - array of n values, values[i] is returned for blocks[i]
+ * Parameter: n      - number of prefixes
+ * Returns: number of prefixes added; less than n if a value was too large or
+ *          the extension groups ran out
+ */
+size_t ipv4_lpm_build(struct ipv4_lpm* lpm, const struct ipv4_cidr* blocks,
+                      const uint32_t* values, size_t n) {
+    const struct ipv4_cidr** order = malloc(n * sizeof(*order));
+    if (order == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        order[i] = &blocks[i];
+    }
+    qsort(order, n, sizeof(*order), ipv4_lpm_order);
+    
+    size_t added = 0;
+    for (size_t i = 0; i < n; i++) {
+        added += (size_t)ipv4_lpm_add(lpm, order[i], values[order[i] - blocks]);
+    }
+    free(order);
+    return added;
+}
+
+/**
+ * Function: ipv4_lpm_lookup
+ * Purpose: Finds the value of the longest prefix containing an address
+ * 
+ * Parameter: lpm   - table to search
+ * Parameter: addr  - packed address, as produced by parse_ipv4()
+ * Parameter: value - receives the value of the longest matching prefix, may be NULL
+ * Returns: 1 if some prefix matched, 0 otherwise
+ */
+int ipv4_lpm_lookup(const struct ipv4_lpm* lpm, uint32_t addr, uint32_t* value) {
+    uint32_t e = lpm->tbl24[addr >> 8];
+    if (e & IPV4_LPM_EXTENDED) {
+        e = lpm->tbl8[(size_t)(e & IPV4_LPM_PAYLOAD) * 256 + (addr & 0xFF)];
+    }
+    if (value != NULL) {
+        *value = e & IPV4_LPM_PAYLOAD;
+    }
+    return (e & IPV4_LPM_VALID) != 0;
+}
+
+/**
+ * Function: ipv4_lpm_lookup_batch
+ * Purpose: Looks up many packed addresses, e.g. the addrs column of validate_ip_batch()
+ * 
+ * The tbl24 entries of upcoming addresses are prefetched while earlier ones are
+ * resolved, which hides most of the cache misses of a 64 MiB table.
+ * 
+ * Parameter: lpm    - table to search
+ * Parameter: addrs  - array of n packed addresses
+ * Parameter: n      - number of addresses
+ * Parameter: found  - receives (n + 7) / 8 bytes; bit (i % 8) of byte (i / 8) is set
+ *                     when some prefix contains addrs[i]; may be NULL
+ * Parameter: values - receives n values (0 where nothing matched), may be NULL
+ * Returns: number of addresses for which some prefix matched
+ */
+size_t ipv4_lpm_lookup_batch(const struct ipv4_lpm* lpm, const uint32_t* addrs, size_t n,
+                             uint8_t* found, uint32_t* values) {
+    size_t hits = 0;
+    for (size_t base = 0; base < n; base += 8) {
+        size_t group = n - base < 8 ? n - base : 8;
+        unsigned bits = 0;
+        for (size_t j = 0; j < group; j++) {
+            size_t i = base + j;
+            if (i + IPV4_PREFETCH_DISTANCE < n) {
+                IPV4_PREFETCH(&lpm->tbl24[addrs[i + IPV4_PREFETCH_DISTANCE] >> 8]);
+            }
+            uint32_t value = 0;
+            unsigned hit = (unsigned)ipv4_lpm_lookup(lpm, addrs[i], &value);
+            bits |= hit << j;
+            hits += hit;
+            if (values != NULL) {
+                values[i] = hit ? value : 0;
+            }
+        }
+        if (found != NULL) {
+            found[base / 8] = (uint8_t)bits;
+        }
+    }
+    return hits;
+}
+
+/*
+ * Dedup cache
+ * 
+ * A small direct-mapped cache in front of parse_ipv4() for heavily skewed
+ * traffic where the same few thousand addresses account for most lines. The
+ * key is the raw candidate itself: at most 15 bytes, held as two 64-bit words
+ * with the length in the otherwise unused 16th byte, so a hit costs one hash
+ * and one 24-byte compare. Rejections are cached too.
+ * 
+ * A cache belongs to one thread (no locks, no atomics); give each worker its
+ * own. It never allocates: the caller provides the memory.
+ */
+
+/**
+ * Function: ipv4_cache_init
+ * Purpose: Empties a cache and resets its counters
+ * 
+ * Parameter: cache - cache to initialize (static, stack or heap memory owned by the caller)
+ */
+void ipv4_cache_init(struct ipv4_cache* cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * Function: ipv4_cache_parse
+ * Purpose: parse_ipv4() with a cache in front
+ * 
+ * Candidates whose length alone rules them out are rejected without touching
+ * the cache. Everything else is looked up by its raw bytes; on a miss the
+ * parser runs and its result (valid or not) replaces whatever was in the slot.
+ * 
+ * Parameter: cache - cache owned by the calling thread
+ * Parameter: ip    - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len   - number of characters at ip that make up the candidate address
+ * Parameter: out   - receives the packed address when valid, may be NULL
+ * Returns: 1 if valid IPv4 address, 0 if invalid
+ */
+int ipv4_cache_parse(struct ipv4_cache* cache, const char* ip, size_t len, uint32_t* out) {
+    if (ip == NULL || len < 7 || len > 15) {
+        return 0;  // Invalid: never worth a cache slot
+    }
+    
+    // Build the key: the bytes zero-padded to 16, length in the last byte
+    uint64_t key0, key1;
+    ipv4_load_slice(ip, len, &key0, &key1);
+    key1 |= (uint64_t)len << 56;
+    
+    // Multiplicative hash of both words; the top bits pick the slot
+    uint64_t h = (key0 ^ (key1 * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+    struct ipv4_cache_entry* e = &cache->slots[(h >> 32) & (IPV4_CACHE_SLOTS - 1)];
+    
+    if (e->key0 == key0 && e->key1 == key1) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+        e->key0 = key0;
+        e->key1 = key1;
+        e->addr = 0;
+        e->valid = (uint32_t)parse_ipv4(ip, len, &e->addr);
+    }
+    if (e->valid && out != NULL) {
+        *out = e->addr;
+    }
+    return (int)e->valid;
+}
+
+/*
+ * Aggregation sketches
+ * 
+ * For jobs that validate and then immediately count: how many distinct valid
+ * addresses there were (struct ipv4_hll) and which ones were seen most often
+ * (struct ipv4_topk). Both take packed addresses, so they fit straight behind
+ * the parser without touching the text again, and both have a fixed size so
+ * every worker can keep its own and the shards are merged once at the end.
+ * 
+ * The HyperLogLog merge is exact: merging shards gives the same registers as
+ * one sketch over everything. The space-saving merge keeps its guarantees
+ * (counts are never underestimated, by at most error) but is not the same as
+ * one sketch over everything once either side has evicted counters.
+ */
+
+_Static_assert((IPV4_TOPK_CAPACITY & (IPV4_TOPK_CAPACITY - 1)) == 0 &&
+               IPV4_TOPK_CAPACITY <= 32768, "lookup table positions must fit in uint16_t");
+
+// 64-bit mix of a packed address (the splitmix64 finalizer), so neighbors land far apart
+static inline uint64_t ipv4_sketch_hash(uint32_t addr) {
+    uint64_t h = (uint64_t)addr + 0x9E3779B97F4A7C15ull;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+// Number of leading zero bits in m, which must not be 0
+static inline unsigned ipv4_clz64(uint64_t m) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_clzll(m);
+#else
+    unsigned n = 0;
+    for (; !(m >> 63); m <<= 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Function: ipv4_hll_init
+ * Purpose: Empties a HyperLogLog sketch
+ * 
+ * Parameter: hll - sketch to initialize (memory owned by the caller)
+ */
+void ipv4_hll_init(struct ipv4_hll* hll) {
+    memset(hll, 0, sizeof(*hll));
+}
+
+/**
+ * Function: ipv4_hll_add
+ * Purpose: Adds one address to a HyperLogLog sketch
+ * 
+ * The top IPV4_HLL_PRECISION bits of the hash pick a register, which keeps
+ * the longest run of leading zeros seen in the remaining bits. Adding the
+ * same address again never changes anything.
+ * 
+ * Parameter: hll  - sketch owned by the calling thread
+ * Parameter: addr - packed address
+ */
+void ipv4_hll_add(struct ipv4_hll* hll, uint32_t addr) {
+    uint64_t h = ipv4_sketch_hash(addr);
+    uint8_t* reg = &hll->registers[h >> (64 - IPV4_HLL_PRECISION)];
+    
+    // The stop bit bounds the rank when all remaining bits are zero
+    uint8_t rank = (uint8_t)(ipv4_clz64((h << IPV4_HLL_PRECISION) |
+                                        (1ull << (IPV4_HLL_PRECISION - 1))) + 1);
+    if (rank > *reg) {
+        *reg = rank;
+    }
+}
+
+/**
+ * Function: ipv4_hll_merge
+ * Purpose: Folds one HyperLogLog sketch into another
+ * 
+ * Parameter: dst - sketch that afterwards counts everything added to either
+ * Parameter: src - sketch to fold in, unchanged
+ */
+void ipv4_hll_merge(struct ipv4_hll* dst, const struct ipv4_hll* src) {
+    for (size_t i = 0; i < IPV4_HLL_REGISTERS; i++) {
+        dst->registers[i] = src->registers[i] > dst->registers[i] ? src->registers[i] : dst->registers[i];
+    }
+}
+
+/**
+ * Function: ipv4_hll_count
+ * Purpose: Estimates how many distinct addresses were added to a sketch
+ * 
+ * The standard HyperLogLog estimate, switching to linear counting while some
+ * registers are still empty. No large-range correction is needed: the hash is
+ * 64 bits wide and there are only 2^32 addresses.
+ * 
+ * Parameter: hll - sketch to read
+ * Returns: estimated number of distinct addresses
+ */
+uint64_t ipv4_hll_count(const struct ipv4_hll* hll) {
+    const double m = (double)IPV4_HLL_REGISTERS;
+    double sum = 0.0;
+    unsigned zeros = 0;
+    for (size_t i = 0; i < IPV4_HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ull << hll->registers[i]);
+        zeros += hll->registers[i] == 0;
+    }
+    
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros != 0) {
+        estimate = m * log(m / zeros);  // Small cardinalities: linear counting
+    }
+    return (uint64_t)(estimate + 0.5);
+}
+
+/*
+ * The top-K counters are kept sorted by count in a "stream summary": runs of
+ * counters with equal counts, each run knowing its first and last counter.
+ * Incrementing a counter swaps it with the last one of its run and moves the
+ * run boundary, so every update is O(1) however many counters are tied, and
+ * the smallest counter (the one space-saving evicts) is always counters[0].
+ * Unused counters have count 0, so they sort first and are taken before any
+ * real one is evicted.
+ */
+
+// Home slot of addr in the top-K lookup table (Fibonacci hashing: the top bits of a multiply)
+static inline size_t ipv4_topk_home(uint32_t addr) {
+    return (size_t)(((uint64_t)addr * 0x9E3779B97F4A7C15ull) >> 40) & (2 * IPV4_TOPK_CAPACITY - 1);
+}
+
+// Lookup table slot that holds addr, or the empty slot where it would go
+static size_t ipv4_topk_find(const struct ipv4_topk* topk, uint32_t addr) {
+    size_t s = ipv4_topk_home(addr);
+    while (topk->index[s] != 0 && topk->counters[topk->index[s] - 1].addr != addr) {
+        s = (s + 1) & (2 * IPV4_TOPK_CAPACITY - 1);
+    }
+    return s;
+}
+
+// Empties lookup table slot s, moving later entries of its probe run back into the gap
+static void ipv4_topk_unlink(struct ipv4_topk* topk, size_t s) {
+    const size_t mask = 2 * IPV4_TOPK_CAPACITY - 1;
+    size_t j = s;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (topk->index[j] == 0) {
+            break;
+        }
+        // An entry may only move back if the gap is not before its home slot
+        size_t home = ipv4_topk_home(topk->counters[topk->index[j] - 1].addr);
+        if (s <= j ? (s < home && home <= j) : (s < home || home <= j)) {
+            continue;
+        }
+        topk->index[s] = topk->index[j];
+        topk->slot[topk->index[s] - 1] = (uint16_t)s;
+        s = j;
+    }
+    topk->index[s] = 0;
+}
+
+// Adds one to counter pos, keeping the counters sorted
+static void ipv4_topk_increment(struct ipv4_topk* topk, uint32_t pos) {
+    uint16_t r = topk->run[pos];
+    uint32_t last = topk->run_last[r];
+    if (pos != last) {
+        // Both are in run r, so only the counters and their table slots move
+        struct ipv4_topk_entry e = topk->counters[pos];
+        topk->counters[pos] = topk->counters[last];
+        topk->counters[last] = e;
+        uint16_t s = topk->slot[pos];
+        topk->slot[pos] = topk->slot[last];
+        topk->slot[last] = s;
+        topk->index[topk->slot[last]] = (uint16_t)(last + 1);
+        if (topk->counters[pos].count != 0) {
+            topk->index[topk->slot[pos]] = (uint16_t)(pos + 1);  // Unused counters have no slot
+        }
+    }
+    
+    // The counter at last leaves run r...
+    uint64_t count = ++topk->counters[last].count;
+    if (topk->run_first[r] == last) {
+        topk->free_runs[topk->free_count++] = r;
+    } else {
+        topk->run_last[r] = (uint16_t)(last - 1);
+    }
+    
+    // ...and joins the next run if that has its new count, or starts one
+    if (last + 1 < IPV4_TOPK_CAPACITY && topk->counters[last + 1].count == count) {
+        uint16_t next = topk->run[last + 1];
+        topk->run_first[next] = (uint16_t)last;
+        topk->run[last] = next;
+    } else {
+        // Never empty here: if run r kept a counter, there are fewer runs than counters
+        uint16_t n = topk->free_runs[--topk->free_count];
+        topk->run_first[n] = topk->run_last[n] = (uint16_t)last;
+        topk->run[last] = n;
+    }
+}
+
+// Rebuilds the lookup table and the runs from the (sorted) counters
+static void ipv4_topk_reindex(struct ipv4_topk* topk) {
+    memset(topk->index, 0, sizeof(topk->index));
+    topk->free_count = 0;
+    for (uint32_t r = IPV4_TOPK_CAPACITY; r-- > 0; ) {
+        topk->free_runs[topk->free_count++] = (uint16_t)r;
+    }
+    for (uint32_t pos = 0; pos < IPV4_TOPK_CAPACITY; pos++) {
+        const struct ipv4_topk_entry* e = &topk->counters[pos];
+        if (e->count != 0) {
+            size_t s = ipv4_topk_find(topk, e->addr);
+            topk->index[s] = (uint16_t)(pos + 1);
+            topk->slot[pos] = (uint16_t)s;
+        }
+        if (pos > 0 && topk->counters[pos - 1].count == e->count) {
+            topk->run[pos] = topk->run[pos - 1];
+            topk->run_last[topk->run[pos]] = (uint16_t)pos;
+        } else {
+            uint16_t n = topk->free_runs[--topk->free_count];
+            topk->run_first[n] = topk->run_last[n] = (uint16_t)pos;
+            topk->run[pos] = n;
+        }
+    }
+}
+
+/**
+ * Function: ipv4_topk_init
+ * Purpose: Empties a top-K sketch
+ * 
+ * Parameter: topk - sketch to initialize (memory owned by the caller)
+ */
+void ipv4_topk_init(struct ipv4_topk* topk) {
+    memset(topk->counters, 0, sizeof(topk->counters));
+    ipv4_topk_reindex(topk);
+}
+
+/**
+ * Function: ipv4_topk_add
+ * Purpose: Counts one occurrence of an address
+ * 
+ * An address that already has a counter gets it incremented. A new one takes
+ * over the smallest counter, an unused one while there are any: its count
+ * becomes that counter's plus one, and the inherited part is its error.
+ * 
+ * Parameter: topk - sketch owned by the calling thread
+ * Parameter: addr - packed address
+ */
+void ipv4_topk_add(struct ipv4_topk* topk, uint32_t addr) {
+    size_t s = ipv4_topk_find(topk, addr);
+    if (topk->index[s] != 0) {
+        ipv4_topk_increment(topk, topk->index[s] - 1u);
+        return;
+    }
+    
+    struct ipv4_topk_entry* e = &topk->counters[0];
+    if (e->count != 0) {
+        ipv4_topk_unlink(topk, topk->slot[0]);
+        s = ipv4_topk_find(topk, addr);  // The unlink may have moved the free slot
+    }
+    e->addr = addr;
+    e->error = e->count;
+    topk->slot[0] = (uint16_t)s;
+    topk->index[s] = 1;
+    ipv4_topk_increment(topk, 0);
+}
+
+// Orders counters by count, smallest first
+static int ipv4_topk_compare(const void* a, const void* b) {
+    uint64_t x = ((const struct ipv4_topk_entry*)a)->count;
+    uint64_t y = ((const struct ipv4_topk_entry*)b)->count;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Function: ipv4_topk_merge
+ * Purpose: Folds one top-K sketch into another
+ * 
+ * Every address in either sketch is counted with the sum of both counts. A
+ * sketch that is full and has no counter for it contributes its smallest
+ * count instead (the most the address could have had there), which keeps the
+ * counts overestimates; then the largest IPV4_TOPK_CAPACITY are kept. Costs
+ * up to O(IPV4_TOPK_CAPACITY^2), which is fine once per shard at the end.
+ * 
+ * Parameter: dst - sketch that afterwards summarizes everything added to either
+ * Parameter: src - sketch to fold in, unchanged
+ */
+void ipv4_topk_merge(struct ipv4_topk* dst, const struct ipv4_topk* src) {
+    // Smallest counts; 0 while a sketch still has unused counters
+    uint64_t dst_min = dst->counters[0].count;
+    uint64_t src_min = src->counters[0].count;
+    
+    // Which of src's addresses dst already has, before anything changes
+    uint8_t shared[IPV4_TOPK_CAPACITY];
+    for (uint32_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        shared[i] = src->counters[i].count == 0 ||
+                    dst->index[ipv4_topk_find(dst, src->counters[i].addr)] != 0;
+    }
+    
+    // Counters in both, or only in dst
+    for (uint32_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        struct ipv4_topk_entry* e = &dst->counters[i];
+        if (e->count == 0) {
+            continue;
+        }
+        size_t s = ipv4_topk_find(src, e->addr);
+        if (src->index[s] != 0) {
+            const struct ipv4_topk_entry* other = &src->counters[src->index[s] - 1];
+            e->count += other->count;
+            e->error += other->error;
+        } else {
+            e->count += src_min;
+            e->error += src_min;
+        }
+    }
+    qsort(dst->counters, IPV4_TOPK_CAPACITY, sizeof(dst->counters[0]), ipv4_topk_compare);
+    
+    // Counters only in src, each pushing out the smallest one if it is larger
+    for (uint32_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        if (shared[i]) {
+            continue;
+        }
+        struct ipv4_topk_entry e = src->counters[i];
+        e.count += dst_min;
+        e.error += dst_min;
+        if (e.count <= dst->counters[0].count) {
+            continue;
+        }
+        uint32_t pos = 0;
+        while (pos + 1 < IPV4_TOPK_CAPACITY && dst->counters[pos + 1].count < e.count) {
+            dst->counters[pos] = dst->counters[pos + 1];
+            pos++;
+        }
+        dst->counters[pos] = e;
+    }
+    ipv4_topk_reindex(dst);
+}
+
+/**
+ * Function: ipv4_topk_result
+ * Purpose: Reads the largest counters out of a top-K sketch
+ * 
+ * Ties are broken by address so the order is reproducible. An address is
+ * certain to be among the true top k when its count minus its error is at
+ * least the count of the first address left out.
+ * 
+ * Parameter: topk - sketch to read
+ * Parameter: out  - receives up to k entries, largest count first
+ * Parameter: k    - room at out
+ * Returns: number of entries written, at most k
+ */
+size_t ipv4_topk_result(const struct ipv4_topk* topk, struct ipv4_topk_entry* out, size_t k) {
+    size_t n = 0;
+    for (uint32_t i = 0; i < IPV4_TOPK_CAPACITY; i++) {
+        const struct ipv4_topk_entry* e = &topk->counters[i];
+        if (e->count == 0) {
+            continue;  // Unused
+        }
+        
+        // Insertion into the sorted prefix; k is small next to the capacity
+        size_t at = n;
+        while (at > 0 && (out[at - 1].count < e->count ||
+                          (out[at - 1].count == e->count && out[at - 1].addr > e->addr))) {
+            at--;
+        }
+        if (at >= k) {
+            continue;
+        }
+        size_t keep = n < k ? n : k - 1;
+        memmove(out + at + 1, out + at, (keep - at) * sizeof(*out));
+        out[at] = *e;
+        n = keep + 1;
+    }
+    return n;
+}
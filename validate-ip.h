@@ -0,0 +1,387 @@
+/*
+ * validate-ip: fast IPv4 (and IPv6) address validation
+ *
+ * Public interface of libvalidate-ip. Build the library with `make lib`
+ * (libvalidate-ip.a and libvalidate-ip.so), include this header and link
+ * with -lvalidate-ip -lm. For the hot path to be inlined into the calling code,
+ * build both the library and the caller with link-time optimization
+ * (`make LTO=1`, and -flto on the caller's side).
+ *
+ * Every function takes the candidate as a pointer and a length, so it need
+ * not be null-terminated and can point straight into a larger buffer, except
+ * validate_ip(), which keeps the original C string interface. Packed IPv4
+ * addresses hold the first octet in the most significant byte, so
+ * "192.168.1.1" is 0xC0A80101. The full documentation of each function is
+ * next to its definition in validate-ip.c.
+ *
+ * Compile-time options (must be the same for the library and its users):
+ *   IPV4_CACHE_SLOTS    slots in struct ipv4_cache, a power of two (default 16384)
+ *   VALIDATE_IP_STATS   instrumentation behind ipv4_stats_snapshot() (library only)
+ *   VALIDATE_IP_OPENCL  GPU backend behind ipv4_gpu_create() (library only, link -lOpenCL)
+ */
+#ifndef VALIDATE_IP_H
+#define VALIDATE_IP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Engines
+ *
+ * parse_ipv4() picks the fastest engine the CPU supports. The others are
+ * exported for benchmarking and testing; they all accept exactly the same
+ * inputs as validate_ip() and produce the same packed value.
+ */
+
+// Defined when the corresponding engine is compiled in
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IPV4_HAVE_SSSE3 1
+#endif
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define IPV4_HAVE_NEON 1
+#endif
+
+// Each returns 1 if valid (storing the address in *out unless out is NULL), 0 if invalid
+int parse_ipv4(const char* ip, size_t len, uint32_t* out);
+int parse_ipv4_scalar(const char* ip, size_t len, uint32_t* out);
+int parse_ipv4_table(const char* ip, size_t len, uint32_t* out);
+int parse_ipv4_branchless(const char* ip, size_t len, uint32_t* out);
+#ifdef IPV4_HAVE_SSSE3
+int parse_ipv4_ssse3(const char* ip, size_t len, uint32_t* out);  // Needs SSSE3 and POPCNT at run time
+#endif
+#ifdef IPV4_HAVE_NEON
+int parse_ipv4_neon(const char* ip, size_t len, uint32_t* out);
+#endif
+
+// The original interface: 1 if ip is a valid dotted-quad C string, 0 if not
+int validate_ip(const char* ip);
+
+// validate_ip() for a slice of n bytes
+int validate_ip_n(const char* p, size_t n);
+
+// Validates n candidates; sets bit (i % 8) of valid_bitmap[i / 8] for each valid one
+size_t validate_ip_batch(const char* const* ips, const size_t* lens, size_t n,
+                         uint8_t* valid_bitmap, uint32_t* addrs);
+
+// Validates the lines of a text buffer, up to *lines of them; returns the bytes consumed
+size_t validate_ip_lines(const char* buf, size_t n, size_t* lines,
+                         uint8_t* valid_bitmap, uint32_t* addrs);
+
+/*
+ * Range classification
+ */
+
+// Special-purpose ranges, as flags: ipv4_classify() sets one for each range an address is in
+#define IPV4_CLASS_PRIVATE       0x01u  // 10.0.0.0/8, 172.16.0.0/12, 192.168.0.0/16 (RFC 1918)
+#define IPV4_CLASS_LOOPBACK      0x02u  // 127.0.0.0/8
+#define IPV4_CLASS_LINK_LOCAL    0x04u  // 169.254.0.0/16
+#define IPV4_CLASS_MULTICAST     0x08u  // 224.0.0.0/4
+#define IPV4_CLASS_CGNAT         0x10u  // 100.64.0.0/10, shared address space (RFC 6598)
+#define IPV4_CLASS_DOCUMENTATION 0x20u  // 192.0.2.0/24, 198.51.100.0/24, 203.0.113.0/24 (RFC 5737)
+#define IPV4_CLASS_BROADCAST     0x40u  // 255.255.255.255
+
+// Flags for a packed address, 0 for an ordinary one: a few compares on the value, no tables
+static inline unsigned ipv4_classify(uint32_t addr) {
+    unsigned private_ = ((addr >> 24) == 10) | ((addr >> 20) == 0xAC1) | ((addr >> 16) == 0xC0A8);
+    unsigned documentation = ((addr >> 8) == 0xC00002) | ((addr >> 8) == 0xC63364) |
+                             ((addr >> 8) == 0xCB0071);
+    return private_ * IPV4_CLASS_PRIVATE |
+           ((addr >> 24) == 127) * IPV4_CLASS_LOOPBACK |
+           ((addr >> 16) == 0xA9FE) * IPV4_CLASS_LINK_LOCAL |
+           ((addr >> 28) == 0xE) * IPV4_CLASS_MULTICAST |
+           ((addr >> 22) == 0x191) * IPV4_CLASS_CGNAT |
+           documentation * IPV4_CLASS_DOCUMENTATION |
+           (addr == 0xFFFFFFFFu) * IPV4_CLASS_BROADCAST;
+}
+
+// parse_ipv4() that also stores ipv4_classify() of the address in *flags (0 when invalid)
+int parse_ipv4_classify(const char* ip, size_t len, uint32_t* out, unsigned* flags);
+
+// validate_ip_batch() with a parallel column of ipv4_classify() flags, one byte per candidate
+size_t validate_ip_batch_classify(const char* const* ips, const size_t* lens, size_t n,
+                                  uint8_t* valid_bitmap, uint32_t* addrs, uint8_t* classes);
+
+/*
+ * GPU backend for validate_ip_lines(), compiled in with VALIDATE_IP_OPENCL
+ */
+
+struct ipv4_gpu;  // Opaque, from ipv4_gpu_create()
+
+// NULL without a usable GPU or without OpenCL support; callers then simply pass NULL on
+struct ipv4_gpu* ipv4_gpu_create(void);
+void ipv4_gpu_free(struct ipv4_gpu* gpu);
+
+// validate_ip_lines() on the GPU; uses the CPU for small batches, a NULL gpu or device errors
+size_t ipv4_gpu_validate_lines(struct ipv4_gpu* gpu, const char* buf, size_t n, size_t* lines,
+                               uint8_t* valid_bitmap, uint32_t* addrs);
+
+/*
+ * IPv6 and mixed input
+ */
+
+/*
+ * An address of either family, as produced by parse_ip()
+ */
+struct ip_addr {
+    unsigned family;    // 4 or 6
+    uint32_t v4;        // Packed IPv4 address (family 4 only), as from parse_ipv4()
+    uint8_t bytes[16];  // 128-bit address in network order; IPv4 as ::ffff:a.b.c.d
+};
+
+// RFC 4291 text form, including "::" and a trailing dotted quad; 1 if valid, 0 if not
+int parse_ipv6(const char* ip, size_t len, uint8_t out[16]);
+
+// Returns 4 or 6 for a valid address of that family, 0 if invalid
+int parse_ip(const char* ip, size_t len, struct ip_addr* out);
+
+size_t parse_ip_batch(const char* const* ips, const size_t* lens, size_t n,
+                      uint8_t* valid_bitmap, struct ip_addr* addrs);
+
+/*
+ * Looser dialects
+ */
+
+#define IPV4_DIALECT_SHORT_FORMS   0x1u  // 1-3 part forms, last part fills the remaining bytes
+#define IPV4_DIALECT_HEX           0x2u  // "0x"/"0X" prefix makes a part hexadecimal
+#define IPV4_DIALECT_OCTAL         0x4u  // Leading '0' makes a part octal
+#define IPV4_DIALECT_LEADING_ZEROS 0x8u  // Leading zeros allowed, part stays decimal
+
+// The inet_aton() rules
+#define IPV4_DIALECT_ATON (IPV4_DIALECT_SHORT_FORMS | IPV4_DIALECT_HEX | IPV4_DIALECT_OCTAL)
+
+int parse_ipv4_aton(const char* ip, size_t len, uint32_t* out);         // IPV4_DIALECT_ATON
+int parse_ipv4_zero_padded(const char* ip, size_t len, uint32_t* out);  // IPV4_DIALECT_LEADING_ZEROS
+
+/*
+ * Formatting
+ */
+
+// Buffer size format_ipv4() needs: "255.255.255.255" and the '\0'
+#define IPV4_FORMAT_SIZE 16
+
+// Null-terminated text of a packed address; returns its length, 7-15
+size_t format_ipv4(uint32_t addr, char out[IPV4_FORMAT_SIZE]);
+
+// Addresses back to back, each followed by sep, no '\0'; returns the bytes written
+size_t format_ipv4_batch(const uint32_t* addrs, size_t n, char sep, char* out);
+
+// Strict form of an inet_aton()-style address; returns its length, 0 if invalid
+size_t ipv4_canonicalize(const char* ip, size_t len, char out[IPV4_FORMAT_SIZE]);
+
+/*
+ * Error reporting
+ */
+
+/*
+ * Why a candidate was rejected, as reported by parse_ipv4_ex()
+ */
+enum ipv4_error {
+    IPV4_OK = 0,             // Valid address
+    IPV4_ERR_LENGTH,         // Null pointer, or length outside 7-15
+    IPV4_ERR_CHARACTER,      // A byte that is neither a digit nor a dot
+    IPV4_ERR_DOT_COUNT,      // Not exactly 3 dots
+    IPV4_ERR_EMPTY_OCTET,    // Nothing between two dots, or at either end
+    IPV4_ERR_LEADING_ZERO,   // An octet with more than one digit starting with '0'
+    IPV4_ERR_RANGE           // An octet above 255
+};
+
+enum ipv4_error parse_ipv4_ex(const char* ip, size_t len, uint32_t* out, size_t* pos);
+const char* ipv4_error_string(enum ipv4_error err);
+
+/*
+ * Instrumentation (counts stay zero unless the library is built with VALIDATE_IP_STATS)
+ */
+
+#define IPV4_STATS_BUCKETS 32  // Bucket b counts samples of [2^b, 2^(b+1)) ticks
+#define IPV4_STATS_REASONS 7   // Entries of enum ipv4_error
+
+/*
+ * Totals returned by ipv4_stats_snapshot()
+ */
+struct ipv4_stats {
+    uint64_t calls;         // Candidates parsed
+    uint64_t accepts;       // Valid ones
+    uint64_t rejects[IPV4_STATS_REASONS];  // Invalid ones by enum ipv4_error (IPV4_OK stays 0)
+    uint64_t bytes;         // Candidate bytes scanned
+    uint64_t samples;       // Timed calls
+    uint64_t latency[IPV4_STATS_BUCKETS];  // Timed calls by log2 of their ticks
+};
+
+// Returns 1 if the library was built with VALIDATE_IP_STATS, 0 if not
+int ipv4_stats_snapshot(struct ipv4_stats* out);
+
+/*
+ * Extraction from free text
+ */
+
+/*
+ * A valid address found inside a larger buffer by ipv4_find_next()
+ */
+struct ipv4_match {
+    size_t offset;   // Offset of the first character of the address in the buffer
+    size_t length;   // Number of characters in the address (7-15)
+    uint32_t addr;   // Packed address, first octet in the most significant byte
+};
+
+int ipv4_find_next(const char* buf, size_t n, size_t* pos, struct ipv4_match* match);
+
+// Characters that can be part of a dotted-quad, for callers that split text into chunks
+static inline int ipv4_is_addr_char(unsigned char c) {
+    return (unsigned)(c - '0') < 10 || c == '.';
+}
+
+#define IPV4_ARENA_DEFAULT_CHUNK (64 << 10)
+#define IPV4_ARENA_MAX_CHUNK (16 << 20)
+#define IPV4_ARENA_ALIGN 16  // Alignment of every allocation
+
+struct ipv4_arena_chunk;
+
+/*
+ * Bump allocator for extraction results, owned by one caller (see ipv4_arena_init())
+ */
+struct ipv4_arena {
+    struct ipv4_arena_chunk* first;    // All chunks, in order
+    struct ipv4_arena_chunk* current;  // Chunk allocations come from
+    size_t chunk_size;                 // Size of the next chunk to create
+    size_t initial_chunk;              // First-chunk size, restored by ipv4_arena_release()
+    void* last;                        // Most recent allocation, which can grow in place
+};
+
+void ipv4_arena_init(struct ipv4_arena* arena, size_t chunk_size);
+void* ipv4_arena_alloc(struct ipv4_arena* arena, size_t size);
+void* ipv4_arena_grow(struct ipv4_arena* arena, void* p, size_t old_size, size_t new_size);
+void ipv4_arena_reset(struct ipv4_arena* arena);
+void ipv4_arena_release(struct ipv4_arena* arena);
+
+// Every match in buf as one array from the arena; 1 on success, 0 when out of memory
+int ipv4_extract_all(struct ipv4_arena* arena, const char* buf, size_t n,
+                     struct ipv4_match** matches, size_t* count);
+
+/*
+ * CIDR blocks and longest-prefix match
+ */
+
+/*
+ * A CIDR block such as "10.0.0.0/8", as produced by parse_ipv4_cidr()
+ */
+struct ipv4_cidr {
+    uint32_t network;  // Network address with all host bits cleared
+    uint32_t mask;     // Netmask, e.g. 0xFF000000 for /8 (0 for /0)
+    unsigned prefix;   // Prefix length, 0-32
+};
+
+int parse_ipv4_cidr(const char* p, size_t n, struct ipv4_cidr* out);
+int ipv4_cidr_contains(const struct ipv4_cidr* block, uint32_t addr);
+size_t ipv4_cidr_match_batch(const struct ipv4_cidr* block, const uint32_t* addrs,
+                             size_t n, uint8_t* bitmap);
+
+// Largest value that can be stored for a prefix
+#define IPV4_LPM_MAX_VALUE 0x00FFFFFFu
+
+struct ipv4_lpm;  // Opaque, from ipv4_lpm_create()
+
+struct ipv4_lpm* ipv4_lpm_create(uint32_t tbl8_groups);
+void ipv4_lpm_free(struct ipv4_lpm* lpm);
+int ipv4_lpm_add(struct ipv4_lpm* lpm, const struct ipv4_cidr* block, uint32_t value);
+size_t ipv4_lpm_build(struct ipv4_lpm* lpm, const struct ipv4_cidr* blocks,
+                      const uint32_t* values, size_t n);
+int ipv4_lpm_lookup(const struct ipv4_lpm* lpm, uint32_t addr, uint32_t* value);
+size_t ipv4_lpm_lookup_batch(const struct ipv4_lpm* lpm, const uint32_t* addrs, size_t n,
+                             uint8_t* found, uint32_t* values);
+
+/*
+ * Dedup cache
+ */
+
+// Number of cache slots, a power of two; entries are 24 bytes each
+#ifndef IPV4_CACHE_SLOTS
+#define IPV4_CACHE_SLOTS 16384
+#endif
+
+#if (IPV4_CACHE_SLOTS & (IPV4_CACHE_SLOTS - 1)) != 0
+#error "IPV4_CACHE_SLOTS must be a power of two"
+#endif
+
+struct ipv4_cache_entry {
+    uint64_t key0;     // Candidate bytes 0-7
+    uint64_t key1;     // Candidate bytes 8-14 and the length (all zero marks an empty slot)
+    uint32_t addr;     // Packed address when valid
+    uint32_t valid;    // Result of parse_ipv4()
+};
+
+/*
+ * A cache belongs to one thread and never allocates: the caller provides it
+ */
+struct ipv4_cache {
+    struct ipv4_cache_entry slots[IPV4_CACHE_SLOTS];
+    uint64_t hits;     // Lookups answered from the cache
+    uint64_t misses;   // Lookups that had to run the parser
+};
+
+void ipv4_cache_init(struct ipv4_cache* cache);
+int ipv4_cache_parse(struct ipv4_cache* cache, const char* ip, size_t len, uint32_t* out);
+
+/*
+ * Aggregation sketches
+ *
+ * Fixed-size summaries of a stream of packed addresses. Like the cache, each
+ * one belongs to one thread and never allocates; give every worker its own
+ * and merge them at the end.
+ */
+
+// HyperLogLog registers: 2^14 of them, about 0.8% standard error
+#define IPV4_HLL_PRECISION 14
+#define IPV4_HLL_REGISTERS (1u << IPV4_HLL_PRECISION)
+
+/*
+ * Estimates the number of distinct addresses added (see ipv4_hll_count())
+ */
+struct ipv4_hll {
+    uint8_t registers[IPV4_HLL_REGISTERS];
+};
+
+void ipv4_hll_init(struct ipv4_hll* hll);
+void ipv4_hll_add(struct ipv4_hll* hll, uint32_t addr);
+void ipv4_hll_merge(struct ipv4_hll* dst, const struct ipv4_hll* src);
+uint64_t ipv4_hll_count(const struct ipv4_hll* hll);
+
+// Counters kept by struct ipv4_topk, a power of two
+#define IPV4_TOPK_CAPACITY 1024
+
+struct ipv4_topk_entry {
+    uint64_t count;  // Times seen, an overestimate by at most error
+    uint64_t error;  // Count inherited from the address this one replaced
+    uint32_t addr;   // Packed address
+};
+
+/*
+ * Space-saving sketch of the most frequent addresses: any address seen more
+ * than total / IPV4_TOPK_CAPACITY times is guaranteed to be in it
+ */
+struct ipv4_topk {
+    struct ipv4_topk_entry counters[IPV4_TOPK_CAPACITY];  // By count, smallest first; count 0 is unused
+    uint16_t slot[IPV4_TOPK_CAPACITY];       // Lookup table slot of each counter
+    uint16_t run[IPV4_TOPK_CAPACITY];        // Run (of equal counts) each counter is in
+    uint16_t run_first[IPV4_TOPK_CAPACITY];  // First counter of each run
+    uint16_t run_last[IPV4_TOPK_CAPACITY];   // Last counter of each run
+    uint16_t free_runs[IPV4_TOPK_CAPACITY];  // Stack of unused run numbers
+    uint32_t free_count;                     // Entries in free_runs
+    uint16_t index[2 * IPV4_TOPK_CAPACITY];  // Lookup table: counter + 1, 0 when empty
+};
+
+void ipv4_topk_init(struct ipv4_topk* topk);
+void ipv4_topk_add(struct ipv4_topk* topk, uint32_t addr);
+void ipv4_topk_merge(struct ipv4_topk* dst, const struct ipv4_topk* src);
+
+// The k largest counters, largest first, into out (room for k); returns how many
+size_t ipv4_topk_result(const struct ipv4_topk* topk, struct ipv4_topk_entry* out, size_t k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VALIDATE_IP_H */
@@ -0,0 +1,152 @@
+/*
+ * Compile-time IPv4 literal validation and parsing for C++
+ *
+ * The same rules as validate_ip() in validate-ip.c, as constexpr functions, so
+ * fixed addresses in config and test code are checked and packed by the
+ * compiler instead of at startup:
+ *
+ *     using namespace ipv4::literals;
+ *     constexpr std::uint32_t gateway = "10.0.0.1"_ipv4;   // 0x0A000001
+ *     constexpr std::uint32_t bad = "10.0.0.01"_ipv4;      // does not compile
+ *
+ * With C++20 the literal operator is consteval, so every use is checked at
+ * compile time. With C++14/17 it is constexpr and only checked at compile
+ * time in a constant expression; IPV4_LITERAL("10.0.0.1") forces that in any
+ * context.
+ *
+ * ipv4::parse() mirrors parse_ipv4_scalar() step by step, so both accept and
+ * reject exactly the same inputs and produce the same packed value.
+ */
+#ifndef VALIDATE_IP_HPP
+#define VALIDATE_IP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#if __cplusplus < 201402L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#error "validate-ip.hpp requires C++14 or later"
+#endif
+
+namespace ipv4 {
+
+/**
+ * Function: parse
+ * Purpose: constexpr version of parse_ipv4(): validates and decodes in one scan
+ *
+ * Parameter: ip  - pointer to the characters to validate (need not be null-terminated)
+ * Parameter: len - number of characters at ip that make up the candidate address
+ * Parameter: out - receives the packed address when valid (first octet in the most
+ *                  significant byte), may be nullptr. Left untouched when invalid.
+ * Returns: true if valid IPv4 address, false if invalid
+ */
+constexpr bool parse(const char* ip, std::size_t len, std::uint32_t* out) noexcept {
+    if (ip == nullptr || len < 7 || len > 15) {
+        return false;  // Invalid: no string, or length outside 7-15
+    }
+
+    std::uint32_t addr = 0;     // Octets completed so far, packed most significant first
+    unsigned octet = 0;         // Value of the octet currently being read
+    unsigned digits = 0;        // Number of digits seen in the current octet
+    unsigned dot_count = 0;     // Number of dots seen so far
+
+    for (std::size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(ip[i]);
+
+        if (c == '.') {
+            if (digits == 0 || ++dot_count > 3) {
+                return false;  // Invalid: empty octet or too many dots
+            }
+            addr = (addr << 8) | octet;
+            octet = 0;
+            digits = 0;
+            continue;
+        }
+
+        unsigned d = static_cast<unsigned>(c) - '0';
+        if (d > 9) {
+            return false;  // Invalid: contains non-digit, non-dot character
+        }
+        if (digits == 1 && octet == 0) {
+            return false;  // Invalid: leading zeros not allowed
+        }
+        octet = octet * 10 + d;
+        if (octet > 255) {
+            return false;  // Invalid: octet value is outside the 0-255 range
+        }
+        digits++;
+    }
+
+    if (dot_count != 3 || digits == 0) {
+        return false;  // Invalid: wrong number of octets
+    }
+    if (out != nullptr) {
+        *out = (addr << 8) | octet;
+    }
+    return true;
+}
+
+/**
+ * Function: validate
+ * Purpose: constexpr version of validate_ip() for string literals and char arrays
+ *
+ * Like validate_ip() the candidate ends at the first '\0', so an array larger
+ * than its string (char buf[16] = "10.0.0.1") gives the same answer. Nothing
+ * past the end of the array is read, even when it holds no '\0'.
+ *
+ * Parameter: ip - null-terminated character array
+ * Returns: true if valid IPv4 address, false if invalid
+ */
+template <std::size_t N>
+constexpr bool validate(const char (&ip)[N]) noexcept {
+    // As ipv4_bounded_len(): one byte past the longest address is enough to reject
+    std::size_t len = 0;
+    while (len < N && len < 16 && ip[len] != '\0') {
+        len++;
+    }
+    return parse(ip, len, nullptr);
+}
+
+namespace detail {
+
+// Parses or throws; throwing during constant evaluation is what fails the build
+constexpr std::uint32_t parse_or_throw(const char* ip, std::size_t len) {
+    std::uint32_t addr = 0;
+    if (!parse(ip, len, &addr)) {
+        throw std::invalid_argument("invalid IPv4 address literal");
+    }
+    return addr;
+}
+
+}  // namespace detail
+
+namespace literals {
+
+/**
+ * Function: operator""_ipv4
+ * Purpose: Packs an IPv4 address literal at compile time, e.g. "10.0.0.1"_ipv4
+ *
+ * Returns: the packed address, first octet in the most significant byte
+ */
+#if defined(__cpp_consteval) && __cpp_consteval >= 201811L
+consteval
+#else
+constexpr
+#endif
+std::uint32_t operator""_ipv4(const char* ip, std::size_t len) {
+    return detail::parse_or_throw(ip, len);
+}
+
+}  // namespace literals
+
+}  // namespace ipv4
+
+/*
+ * Packs a string literal at compile time in any context and under any
+ * supported standard; an invalid literal is a compile error
+ */
+#define IPV4_LITERAL(s) \
+    (std::integral_constant<std::uint32_t, ::ipv4::detail::parse_or_throw(s, sizeof(s) - 1)>::value)
+
+#endif /* VALIDATE_IP_HPP */